@@ -16,9 +16,15 @@
 #include <glm/glm.hpp>
 #include <time.h>
 #include <iostream>
+#include <thread>
+#include <atomic>
 
 #include "shaders/TextureManager.h"
 #include "shaders/ShaderManager.h"
+#include "shaders/UniformBuffer.h"
+#include "shaders/GpuProfiler.h"
+#include "shaders/ocean.h"
+#include "shaders/cloudLight.h"
 #include "shaders/ply.h"
 #include "gfxDefs.h"
 
@@ -39,6 +45,8 @@ public:
 
 	// Frame counter
 	int frameCounter = 0;
+	int animationFrame = 0;		// time of the ocean and the cloud drift, held while progressive refinement accumulates
+	int animate;			// advance animationFrame, off renders only when something changes
 
 	// Cloud Parameters
 	float cloudDensity;
@@ -47,6 +55,42 @@ public:
 	float cloudBottom;
 	float cloudTop;
 	float sampleRange;
+	float cloudStepSize;	// ray march step near the camera
+	int cloudScale;		// clouds are marched once per cloudScale x cloudScale pixels
+	int cloudMarchStride;	// one cloud pixel out of cloudMarchStride x cloudMarchStride is marched per frame, the rest is reprojected
+	int cloudSkipEmpty;		// leap over noise cells that can not hold cloud
+	float cloudLightAbsorption;	// extinction per world unit toward the light
+
+	// Formats of the object pass targets: 0 RGB10_A2 / R16F, 1 RGBA16F / R16F, 2 RGBA32F / R32F
+	int renderQuality;
+
+	// Dynamic resolution: the object and cloud passes render at renderScale of the window,
+	// lowered and raised to keep the GPU frame time near frameBudget (ms)
+	int dynamicResolution;
+	float frameBudget;
+	float renderScale;
+	float gpuFrameTime;		// smoothed, ms
+
+	// Progressive refinement: while nothing changes, jittered frames are averaged until
+	// progressiveSamples of them are accumulated, then drawing stops
+	int progressive;
+	int progressiveSamples;
+	int accumulatedSamples;
+
+	// Debug view of the work per pixel as a heatmap: 0 off (the image), 1 kd-tree nodes visited,
+	// 2 triangles tested, 3 sea steps, 4 cloud steps. Histograms are printed while it is on.
+	int costView;
+
+	// Scene light, shades the objects, the sea and the clouds
+	glm::vec3 lightPos;
+
+	// Cloud noise generator parameters
+	int noiseResolution;
+	int noiseOctaves;
+
+	// FFT ocean, rebuilt when the parameters change
+	OceanParams oceanParams;
+	float oceanHeightScale;		// world height of one unit of FFT height
 
 	// Camera
 	float scale;
@@ -94,20 +138,89 @@ public:
 	void bindKDTree(std::vector<float>& array);
 	void initializeFBO(int width, int height);
 	void resizeFBO(int width, int height);
-	void readFBOData(int width, int height);
+	void setCloudScale(int scale);
+	void setCloudMarchStride(int stride);
+	void setRenderQuality(int quality);
+	void setAnimationFrame(int frame);
+	bool isConverged();
+	bool sceneChanged();
+	bool needsRedraw();
+	void drawOffscreen(GLuint framebuffer);
+	void finishCloudLight();
 
 	void loadPLY(std::string filename);
 	void loadPlane();
 	void initShaders();
 	void loadNoise(std::string filename);
+	void generateNoise();
+	void setOceanParams(const OceanParams& params);
 	TextureManager* getTextureManager() { return myTextureManager; }
+	GpuProfiler* getProfiler() { return profiler; }		// NULL until the first frame
 
 private:
+	typedef ShaderProgram::Uniform Uniform;
+
+	// Uniform handles of each program, resolved by resolveUniforms whenever the programs are linked.
+	// Camera, light and cloud parameters are not among them, they live in the shared uniform blocks.
+	struct MarchUniforms {
+		Uniform marchSize, marchStride, marchOffset;
+	};
+	struct ObjectUniforms {
+		Uniform meshTrans, frameCounter;
+		Uniform oceanHeight, oceanHeightBounds, oceanNormal, oceanPatchSize, oceanLevels, oceanHeightScale;
+		std::vector<Uniform> meshBuffer, treeBuffer;
+		Uniform numMeshBuffers, maxTrianglesPerBuffer, meshSize;
+		Uniform numTreeBuffers, maxNodesPerBuffer, rootIndex, treeSize;
+	};
+	struct EnvironmentUniforms {
+		Uniform colorMap, distanceMap, cloudMap, cloudDepthMap, seaTex, seaNormalTex;
+		Uniform framebufferSize, frameCounter;
+		Uniform costMap, cloudStepsMap, costView, costScale;
+	};
+	struct CloudUniforms {
+		MarchUniforms march;
+		Uniform noiseTex, distanceMap, cloudGrid, cloudGridCells, skipEmpty;
+		Uniform cloudLight, cloudLightShift, cloudLightValid, blueNoise;
+		Uniform frameCounter, animationFrame;
+	};
+	struct CloudResolveUniforms {
+		MarchUniforms march;
+		Uniform marchMap, distanceMap, historyMap, historyDepthMap, historyValid;
+		Uniform prevEyePosition, prevLookVec, prevUpVec, cloudSize, driftFrames;
+	};
+
 	void draw();
+	void setupContext();
+	void initializeResources();
 	void drawScene();
+
+	void resolveUniforms();
+	void bindUniformBlocks();
+	void uploadUniformBlocks();
 	
 	void flatSceneData();
-	void flatSceneDataRec(SceneNode* node, glm::mat4 curMat);
+
+	void updateOcean();
+
+	void updateCostTarget();
+	void readCostStats();
+
+	void updateRenderScale();
+	void updateRenderSize();
+
+	uint64_t sceneHash();
+	void updateProgressive();
+	void resizeAccumulation();
+	void presentAccumulation();
+
+	void initializeCloudFBO();
+	void resizeCloudFBO();
+	void drawClouds();
+	void resolveClouds();
+	void updateNoise();
+	void updateCloudGrid();
+	void updateCloudLight();
+	void printCloudStats();
 
 	
 
@@ -115,27 +228,90 @@ private:
 	void resize(int x, int y, int w, int h);
 	void updateCamera(int width, int height);
 
-	// vertex buffer
+	// vertex array
 	void initializeVertexBuffer();
-	
-	// Worley points
 
-	// Cell size for worley noise
-	float numCellsPerAxis;
-	std::vector<glm::vec3> worleyPoints;
-	std::vector<glm::vec3> CreateWorleyPoints(int numCellsPerAxis);
-	void updateWorleyPoints(int numCellsPerAxis);
 
-
-	GLuint vao;
-	GLuint vbo;
-	std::vector<float> pixelIndices;
+	GLuint vao;		// empty, every pass generates its vertices from gl_VertexID
 	GLuint colorTexID;
 	GLuint distanceTexID;
 	GLuint fbo;
+	bool renderQualityDirty;
+	GLuint outputFBO;		// where the environment pass draws, 0 for the window
+
+	// per pixel traversal counters of the object pass, third attachment of fbo, allocated for the cost view
+	GLuint costTexID;
+	int costWidth;
+	int costHeight;
+	float costScale[4];		// count shown as red for each view, the 99th percentile of the last readback
+
+	// size of the color and distance targets
+	int renderWidth;
+	int renderHeight;
+	int framesSinceScaleChange;
+	bool resourcesReady;		// vertex array and render targets created by initializeResources
+	GpuProfiler* profiler;		// GPU time of each pass, its frame total drives the render scale
+
+	// window sized average of the progressive refinement samples
+	GLuint accumFBO;
+	GLuint accumTexID;
+	int accumWidth;
+	int accumHeight;
+	glm::vec2 pixelJitter;		// ray offset of this sample, in pixels
+	uint64_t lastSceneHash;
+	int framesSinceChange;
+	int sceneVersion;		// bumped by every change sceneHash can not see, like a new scene or noise
+
+	// low resolution cloud targets, ping-ponged so the previous frame stays readable as history
+	GLuint cloudFBOs[2];
+	GLuint cloudTexIDs[2];
+	GLuint cloudDepthTexIDs[2];
+	int cloudTargetWidth;
+	int cloudTargetHeight;
+	bool cloudTargetDirty;
+	int cloudHistoryIndex;		// target written last frame
+	bool cloudHistoryValid;
+
+	// pixels marched this frame, one per cloudMarchStride x cloudMarchStride block of the cloud target
+	GLuint marchFBO;
+	GLuint marchTexID;
+	GLuint marchStepsTexID;		// density evaluations and skipped cells per marched ray
+	GLuint blueNoiseTexID;		// per pixel march start offsets
+	int marchWidth;
+	int marchHeight;
+
+	// camera of the previous frame, for reprojection
+	glm::vec3 prevEyePosition;
+	glm::vec3 prevLookVec;
+	glm::vec3 prevUpVec;
+	int prevAnimationFrame;
 
 	// noise texture
 	ppm* noiseTex;
+	int noiseTextureSize;		// voxels per axis of noiseTex
+
+	// per cell max of noiseTex, for empty space skipping
+	GLuint cloudGridTexID;
+	int cloudGridCells;
+	bool cloudGridDirty;
+
+	// light transmittance over the cloud box, rebuilt on a worker thread when the parameters
+	// change or the clouds drifted too far from where they were when it was built
+	GLuint cloudLightTexID;
+	bool cloudLightValid;
+	bool cloudLightNoiseDirty;
+	CloudLightParams cloudLightBuilt;		// volume on the GPU
+	CloudLightParams cloudLightPending;		// volume being built
+	std::vector<float> cloudLightVolume;
+	std::thread cloudLightThread;
+	std::atomic<bool> cloudLightReady;
+
+	// ocean height, min / max pyramid and normal textures, refreshed every frame
+	Ocean* ocean;
+	bool oceanDirty;
+	GLuint oceanHeightTexID;
+	GLuint oceanBoundsTexID;
+	GLuint oceanNormalTexID;
 
 	// texture buffer
 	std::vector<GLuint> meshTextureBuffers;
@@ -149,6 +325,21 @@ private:
 
 	TextureManager* myTextureManager;
 	ShaderManager* myShaderManager;
+
+	// programs and their uniforms, so drawing does no lookups by name
+	ShaderProgram* objectProgram;
+	ShaderProgram* environmentProgram;
+	ShaderProgram* cloudProgram;
+	ShaderProgram* cloudResolveProgram;
+	ObjectUniforms objectUniforms;
+	EnvironmentUniforms environmentUniforms;
+	CloudUniforms cloudUniforms;
+	CloudResolveUniforms cloudResolveUniforms;
+
+	// camera, light and cloud uniform blocks shared by all programs, uploaded only when they change
+	UniformBuffer* cameraBuffer;
+	UniformBuffer* lightBuffer;
+	UniformBuffer* cloudBuffer;
 	ply* myObjectPLY;
 
 	glm::mat4 perspectiveMatrix;
@@ -95,7 +95,7 @@ public:
     int lastF;
 public:
     Mesh() { };
-    Mesh(int vcount, int fcount) { vertices = new Vertex*[vcount]; faces = new Face*[fcount]; lastV = 0; lastF = 0; };
+    Mesh(int vcount, int fcount) { vertices = new Vertex*[vcount]; edges = nullptr; faces = new Face*[fcount]; lastV = 0; lastF = 0; };
     ~Mesh() { clear(); };
     void addVertex(Vertex* v);
     void addEdge(Edge* e);
@@ -62,12 +62,28 @@ public:
     std::vector<int> faceIndexes;
 };
 
+// shape of a built meshKDTree
+struct meshKDTreeStats {
+    int nodes = 0;
+    int leaves = 0;
+    int emptyLeaves = 0;
+    int truncatedLeaves = 0;        // leaves with more triangles than the 6 the array layout keeps
+    int maxDepth = 0;
+    float meanLeafDepth = 0.0f;
+    int maxLeafTriangles = 0;
+    float meanLeafTriangles = 0.0f;
+    // surface area heuristic: nodes visited plus triangles tested by a random ray through the root box,
+    // the shader visits every node the ray hits
+    float sahCost = 0.0f;
+};
+
 class meshKDTree {
 public:
     int rootIndex;
     std::vector<meshKDTreeNode> nodes;
     void build(const std::vector<float>& array, int max_triangles_per_leaf = 5);
     int buildRec(const std::vector<float>& array, std::vector<int>& faceIndexes, int depth, int max_triangles_per_leaf);
+    meshKDTreeStats getStats() const;
     /*
          1 -  3: left, right, 0.0f
          4 -  6: min_xyz
@@ -101,9 +117,11 @@ private:
     std::vector<SceneGraphNode*> list;
     KDTree* tree;
 public:
-    SceneGraph() { };
+    SceneGraph() : tree(nullptr) { };
     ~SceneGraph() { clear(); };
     void addNode(SceneGraphNode* node) { this->list.push_back(node); };
+    // adds the primitives of a parsed scene node and its children, curMat is the transformation above it
+    void flatten(SceneNode* node, glm::mat4 curMat);
     void clear() { for (auto node : this->list) { delete node; }; this->list.clear(); delete this->tree; this->tree = nullptr; };
     std::vector<SceneGraphNode*>::iterator getIterator() { return this->list.begin(); };
     std::vector<SceneGraphNode*>::iterator getEnd() { return this->list.end(); };
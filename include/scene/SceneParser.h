@@ -75,6 +75,7 @@ public:
     // Accessors
     int getWidth() const { return width; }
     int getHeight() const { return height; }
+    // Bilinearly filtered color, (u, v) wraps around after being scaled by the repeat factors
     glm::vec3 getColor(float u, float v, float repeatU, float repeatV) const;
 
 private:
@@ -82,7 +83,13 @@ private:
     std::string filename;
     int width;
     int height;
-    std::map<std::pair<int, int>, glm::vec3> colors;
+    std::vector<unsigned char> texels;  // row-major RGB, 3 bytes per texel
+
+    // Color of texel (x, y) in [0, 1], coordinates must be in range
+    glm::vec3 getTexel(int x, int y) const {
+        const unsigned char* texel = &texels[3 * ((size_t)y * width + x)];
+        return glm::vec3(texel[0], texel[1], texel[2]) * (1.0f / 255.0f);
+    }
 
     // Load the PPM file (simplified version)
     void loadFromFile(const std::string& filename);
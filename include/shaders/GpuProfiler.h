@@ -0,0 +1,66 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#if defined(__APPLE__)
+#  include <OpenGL/gl3.h> // defines OpenGL 3.0+ functions
+#else
+#  if defined(WIN32)
+#    define GLEW_STATIC 1
+#  endif
+#  include <GL/glew.h>
+#endif
+
+#include <string>
+#include <vector>
+
+// GPU time of each stage of a frame, measured with GL_TIME_ELAPSED queries.
+// Results come back a few frames late; a small ring of frames keeps the CPU from ever waiting
+// on them, and a frame is simply not measured when every slot is still in flight.
+// Elapsed time queries can not nest, stages run one after the other between beginFrame() and endFrame().
+// The last window frames are kept for the averages and percentiles.
+class GpuProfiler {
+public:
+    struct Stats {
+        int samples;
+        double mean, p50, p95, p99, max;   // milliseconds
+    };
+
+    GpuProfiler(const std::vector<std::string>& stageNames, int window = 240);
+    ~GpuProfiler();
+
+    void beginFrame();
+    void endFrame();
+    // times the GPU work issued until end(), stages that are not begun in a frame count as 0 ms
+    void begin(int stage);
+    void end();
+
+    // collects the frames whose queries finished, false if there is none;
+    // frameMilliseconds is the total of the newest one
+    bool poll(double& frameMilliseconds);
+
+    int getStageCount() const { return (int)stageNames.size(); }
+    const std::string& getStageName(int stage) const { return stageNames[stage]; }
+    // stage getStageCount() is the whole frame
+    Stats getStats(int stage) const;
+
+    // one row per stage and one for the frame: stage,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms
+    bool writeCSV(const std::string& filename) const;
+
+private:
+    static const int FRAME_COUNT = 4;
+    std::vector<std::string> stageNames;
+    std::vector<GLuint> queries;        // FRAME_COUNT x stages
+    std::vector<char> issued;           // whether the stage was begun in that frame
+    int next;           // frame slot used by the next beginFrame()
+    int pending;        // frames ended but not read back yet
+    bool measuring;     // the current frame has a slot
+    int running;        // stage between begin() and end(), -1 if none
+
+    // per stage, then the frame total, window samples each in a ring
+    std::vector<std::vector<float>> history;
+    int window;
+    int historyNext;
+    int historyCount;
+};
+
+#endif // GPU_PROFILER_H
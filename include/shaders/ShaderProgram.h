@@ -1,12 +1,24 @@
 #ifndef SHADER_PROGRAM_H
 #define SHADER_PROGRAM_H
 
+#include <map>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
 using namespace std;
 
 class ShaderProgram {
 
 public:
 
+	// Handle to an active uniform, resolved once by name with getUniform.
+	// Setting an inactive uniform does nothing, like location -1 in glUniform*.
+	struct Uniform {
+		int index = -1;
+		bool valid() const { return index >= 0; }
+	};
+
 	ShaderProgram();
 	~ShaderProgram();
 
@@ -14,6 +26,47 @@ public:
 
 	unsigned int vertexShaderID;
 	unsigned int fragmentShaderID;
+
+	/*	===============================================
+	Desc:	Queries every active uniform of the linked program, array elements included
+			as "name[i]", and forgets all cached values.
+	Precondition: The program is linked
+	Postcondition: getUniform only looks up the table, no GL call
+	=============================================== */
+	void reflectUniforms();
+	Uniform getUniform(const std::string& name) const;
+
+	void use();
+
+	/*	===============================================
+	Desc:	Typed uniform setters. The last value sent is cached per uniform and a value
+			equal to it is not sent again.
+	Precondition: The program is in use
+	Postcondition: Prints a warning once when the type does not match the shader
+	=============================================== */
+	void set(Uniform uniform, int value);
+	void set(Uniform uniform, float value);
+	void set(Uniform uniform, int x, int y);
+	void set(Uniform uniform, const glm::vec2& value);
+	void set(Uniform uniform, const glm::vec3& value);
+	void set(Uniform uniform, const glm::vec4& value);
+	void set(Uniform uniform, const glm::mat4& value);
+
+private:
+	struct UniformState {
+		std::string name;
+		int location;
+		unsigned int type;
+		bool hasValue;		// cache holds what the program currently has
+		bool warned;
+		float cache[16];
+	};
+
+	// true if the value differs from the cache, which then takes it
+	bool update(Uniform uniform, const void* value, size_t bytes, unsigned int type);
+
+	std::vector<UniformState> uniforms;
+	std::map<std::string, int> uniformIndex;
 };
 
 
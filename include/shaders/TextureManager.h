@@ -38,10 +38,28 @@ class TextureManager {
 		void loadTexture(std::string textureName, std::string fileName);
 		void deleteTexture(std::string textureName);
 		unsigned int getTextureID (std::string textureName);
-		void loadTexture3D(std::string textureName, std::string fileName);
+		// The image behind the texture getTextureID returns, NULL if there is none
+		ppm* getTexture(std::string textureName);
+		/*	===============================================
+		Desc:	Loads a tiled ppm as a 3D texture. With slicesPerFrame > 0 the file is read again
+				and, if the name already has a texture, the slices are uploaded a few at a time
+				by updateTextures instead of all at once. getTextureID and getTexture keep
+				returning the old texture until the new one is complete.
+		Precondition: 
+		Postcondition: Returns the voxels per axis, read from the image size, 0 if it holds no cube
+		=============================================== */
+		int loadTexture3D(std::string textureName, std::string fileName, int slicesPerFrame = 0);
+		// Takes ownership of an image generated in memory and binds it as a 3D texture of sizeT slices
+		void addTexture3D(std::string textureName, ppm* image, unsigned int sizeT);
+		// Continues pending incremental uploads, called once per frame.
+		// Returns whether any of them completed and replaced the texture in use.
+		bool updateTextures();
 		
 	private:
 		std::map<std::string, ppm*> textures;
+		std::map<std::string, int> pendingUploads;	// texture name -> slices uploaded per frame
+		std::map<std::string, ppm*> previousTextures;	// textures in use while a pending upload runs
+		ppm* getPreviousTexture(std::string textureName);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#if defined(__APPLE__)
+#  include <OpenGL/gl3.h> // defines OpenGL 3.0+ functions
+#else
+#  if defined(WIN32)
+#    define GLEW_STATIC 1
+#  endif
+#  include <GL/glew.h>
+#endif
+
+#include <cstddef>
+#include <vector>
+
+// A std140 uniform block backed by one buffer object.
+// The buffer stays bound to its binding point, programs only need bindProgram() once after linking.
+class UniformBuffer {
+public:
+    UniformBuffer(GLuint bindingPoint, size_t size);
+    ~UniformBuffer();
+
+    // replaces size bytes starting at offset, does nothing when they match what was uploaded last
+    void update(const void* data, size_t size, size_t offset = 0);
+
+    // points the program's block called blockName at this buffer, ignored if the program does not use it
+    void bindProgram(GLuint programID, const char* blockName);
+
+    GLuint getBindingPoint() const { return bindingPoint; }
+    size_t getSize() const { return size; }
+
+private:
+    GLuint bufferID;
+    GLuint bindingPoint;
+    size_t size;
+    std::vector<unsigned char> contents;    // copy of the buffer, starts zeroed
+};
+
+#endif // UNIFORM_BUFFER_H
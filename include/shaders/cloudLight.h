@@ -0,0 +1,34 @@
+#ifndef CLOUD_LIGHT_H
+#define CLOUD_LIGHT_H
+
+#include <vector>
+#include "ppm.h"
+
+// Everything the cloud density field and the light direction depend on,
+// mirrors the uniforms of cloud-frag.shader
+struct CloudLightParams {
+    float width = 250.0f;           // box is [-width, width] x [bottom, top] x [-width, width]
+    float bottom = 1.0f;
+    float top = 5.0f;
+    float sampleRange = 50.0f;
+    float cloudSpeed = 2.0f;
+    float cloudDensity = 1.0f;
+    int frame = 0;                  // frameCounter the noise scroll is evaluated at
+    float lightPos[3] = { 300.0f, 300.0f, 300.0f };
+    float absorption = 1.0f;        // extinction per world unit at density 1
+    int sizeX = 128;                // voxels across the box
+    int sizeY = 16;
+    int sizeZ = 128;
+};
+
+// Copy of a tiled noise volume (laid out as for ppm::bindTexture3D) as size^3 bytes, x fastest.
+// Empty if the image has no pixels.
+std::vector<unsigned char> readNoiseVolume(ppm* image, int size);
+
+// Beer-Lambert transmittance from the center of every voxel of the cloud box to the light,
+// exp(-absorption * integral of density), as sizeX * sizeY * sizeZ floats, x fastest.
+// The density is getDensity of cloud-frag.shader with the two finest detail layers replaced
+// by their mean, since the volume is far too coarse to resolve them.
+std::vector<float> buildCloudTransmittance(const std::vector<unsigned char>& noise, int noiseSize, const CloudLightParams& params);
+
+#endif // CLOUD_LIGHT_H
@@ -0,0 +1,16 @@
+#ifndef IMAGE_FILE_H
+#define IMAGE_FILE_H
+
+#include <string>
+#include <vector>
+
+// Writers for rendered frames. Pixels are RGB, rows top first, and the same pixels always
+// give the same bytes, so files can be compared with a checksum.
+
+// 8 bit RGB as PNG, deflate without compression so no zlib is needed.
+bool writePNG(const std::string& fileName, int width, int height, const std::vector<unsigned char>& rgb);
+
+// 32 bit float RGB as an uncompressed scanline OpenEXR file, values above 1 are kept.
+bool writeEXR(const std::string& fileName, int width, int height, const std::vector<float>& rgb);
+
+#endif // IMAGE_FILE_H
@@ -0,0 +1,30 @@
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <vector>
+#include "ppm.h"
+
+struct CloudNoiseParams {
+    int resolution = 128;       // voxels per axis
+    int octaves = 4;            // fBm octaves for both perlin and worley
+    int perlinFrequency = 4;    // perlin lattice cells per axis in the first octave
+    int worleyCells = 4;        // worley cells per axis in the first octave
+    unsigned int seed = 42;
+};
+
+// Tileable perlin-worley fBm volume in [0, 255].
+// Slices are stacked vertically, so the result is a resolution x (resolution * resolution)
+// image that bindTexture3D(resolution) turns into a resolution^3 texture.
+ppm* generateCloudNoise(const CloudNoiseParams& params);
+
+// Max of a tiled noise volume (laid out as for ppm::bindTexture3D, size^3 voxels) over each
+// cell of a cells^3 grid covering one period of the noise sampled at frequency * coord.
+// Every cell is widened by a voxel, so it also bounds the linearly filtered texture.
+// Returns cells^3 values in [0, 255], x fastest, or an empty grid if the image has no pixels.
+std::vector<unsigned char> buildNoiseMaxGrid(ppm* image, int size, int cells, int frequency);
+
+// Tileable size x size blue noise by void-and-cluster, every value in [0, 255] equally often.
+// Meant for per-pixel dither offsets: neighbouring pixels get far apart values.
+std::vector<unsigned char> generateBlueNoise(int size, unsigned int seed = 42);
+
+#endif // NOISE_H
@@ -2,6 +2,7 @@
 #define OCEAN_H
 
 #include <vector>
+#include <complex>
 
 struct WaveData {
     float dirX, dirZ;
@@ -10,6 +11,81 @@ struct WaveData {
     float phaseOffset;
 };
 
-std::vector<WaveData> generatePhillipsSpectrum();
+struct OceanParams {
+    int N = 32;                 // grid resolution (N x N wave vectors)
+    float L = 64.0f;            // physical size of the patch
+    float windSpeed = 32.0f;
+    float windDirX = 1.0f;      // wind direction, normalized when used
+    float windDirZ = 0.0f;
+    float waveAmp = 0.0002f;    // energy scale A
+    float damping = 0.001f;     // suppresses waves shorter than damping * L_wind
+    bool halfPlane = true;      // only the m' < N / 2 half of the wave vectors (wave list only)
+    unsigned int seed = 42;     // phase offsets
+    float choppiness = 1.0f;    // horizontal displacement scale of the FFT ocean
+};
+
+std::vector<WaveData> generatePhillipsSpectrum(const OceanParams& params = OceanParams());
+
+// Height of the sum of waves at (x, z) and time t, same formula as calculateWaveHeight in object-frag.shader
+float evaluateWaveHeight(const std::vector<WaveData>& waves, float x, float z, float t);
+
+// Bakes a size x size height and normal map of the world square [0, worldSize)^2 at time t,
+// rows are split across threads. heights gets one float per texel, normals three.
+void bakeWaveMaps(const std::vector<WaveData>& waves, int size, float worldSize, float t,
+                  std::vector<float>& heights, std::vector<float>& normals);
+
+// Tessendorf FFT ocean on an N x N grid (N a power of two) that tiles every L world units.
+// update(t) evolves h0(k) to time t and runs the inverse FFTs, rows and columns split across threads.
+// The choppy surface is then resampled onto the regular grid, so it can be ray marched as a plain
+// heightfield through a min / max pyramid.
+class Ocean {
+public:
+    Ocean(const OceanParams& params);
+
+    void update(float t);
+
+    int getSize() const { return N; }
+    float getPatchSize() const { return L; }
+    // 3 floats per texel: choppy displacement x, height, choppy displacement z
+    const std::vector<float>& getDisplacement() const { return displacement; }
+    // 1 float per texel: height of the displaced surface above each grid point
+    const std::vector<float>& getHeights() const { return heights; }
+    // 3 floats per texel: unit normal of the displaced surface
+    const std::vector<float>& getNormals() const { return normals; }
+    // log2(N) + 1 levels, level l has (N >> l)^2 cells of 2 floats: min and max height.
+    // A level 0 cell spans grid points (i, j) to (i + 1, j + 1), wrapping around the patch.
+    int getLevelCount() const { return (int)heightBounds.size(); }
+    const std::vector<float>& getHeightBounds(int level) const { return heightBounds[level]; }
+
+private:
+    typedef std::complex<float> Complex;
+
+    void inverseFFT(std::vector<Complex>* spectra[], int count);
+    void resolveSurface();
+    void buildHeightBounds();
+
+    int N;
+    int logN;
+    int rowsPerThread;          // least rows a thread of a per frame pass takes
+    float L;
+    float choppiness;
+
+    std::vector<Complex> h0;            // h0(k)
+    std::vector<Complex> h0MinusConj;   // conj(h0(-k))
+    std::vector<float> omega;           // dispersion sqrt(g |k|)
+    std::vector<float> kX, kZ;          // wave vector, 0 at k = 0
+    std::vector<Complex> twiddles;      // exp(2 pi i j / N), j < N / 2
+    std::vector<int> bitReverse;
+
+    std::vector<Complex> heightSlopeX;  // h + i * dh/dx
+    std::vector<Complex> displaceXZ;    // Dx + i * Dz
+    std::vector<Complex> slopeZ;        // dh/dz
+
+    std::vector<float> displacement;
+    std::vector<float> slopes;          // dh/dx, dh/dz before displacement
+    std::vector<float> heights;
+    std::vector<float> normals;
+    std::vector<std::vector<float>> heightBounds;
+};
 
 #endif // OCEAN_H
@@ -0,0 +1,53 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Splitting CPU work over the cores. Both helpers start their threads, run the work on the
+// calling thread as well and join before returning.
+
+// Threads worth starting for count items, at least 1 and at most one per core
+inline int parallelThreadCount(int count) {
+    return std::max(1, std::min((int)std::max(1u, std::thread::hardware_concurrency()), count));
+}
+
+// Runs work(first, last) over [0, count) in one contiguous range per thread. Ranges hold at
+// least minPerThread items, so work too small to pay for starting threads runs serially.
+template <typename Work>
+void parallelFor(int count, Work work, int minPerThread = 1) {
+    int threadCount = parallelThreadCount(count / std::max(minPerThread, 1));
+    std::vector<std::thread> workers;
+    for (int thread = 1; thread < threadCount; thread++) {
+        workers.push_back(std::thread(work, count * thread / threadCount, count * (thread + 1) / threadCount));
+    }
+    work(0, count / threadCount);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Runs body(i) for every i in [0, count), handing the items out one at a time so that items
+// of uneven cost still keep every thread busy
+template <typename Body>
+void parallelEach(int count, Body body) {
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) {
+            body(i);
+        }
+    };
+    int threadCount = parallelThreadCount(count);
+    std::vector<std::thread> workers;
+    for (int thread = 1; thread < threadCount; thread++) {
+        workers.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+#endif // PARALLEL_H
@@ -16,6 +16,7 @@
 #define PPM_H
 
 #include <string>
+#include <vector>
 
 /*
 	A ppm is a simple image format.
@@ -38,6 +39,12 @@ class ppm{
 		=============================================== */ 
 		ppm(std::string _fileName);
 		/*	===============================================
+		Desc:	Constructor for an image generated in memory
+		Precondition: _width and _height are positive
+		Postcondition: The array 'color' is allocated and cleared to black.
+		=============================================== */ 
+		ppm(int _width, int _height);
+		/*	===============================================
 		Desc:	Default destructor for a ppm
 		Precondition: 
 		Postcondition: 'color' array memory is deleted,
@@ -49,6 +56,12 @@ class ppm{
 		Postcondition:
 		=============================================== */ 
 		void setPixel(int x, int y, int r, int g, int b);
+		/*	===============================================
+		Desc:	Writes the image as an ASCII P3 file
+		Precondition: 
+		Postcondition: Returns false if the file could not be written
+		=============================================== */ 
+		bool save(std::string _fileName);
 
 		// Getter functions
 		int getWidth() { return width;}
@@ -58,6 +71,21 @@ class ppm{
 		unsigned int bindTexture();
 		unsigned int getTextureID();
 		unsigned int bindTexture3D(unsigned int sizeT);
+		/*	===============================================
+		Desc:	Edge length of the cube a tiled volume image holds
+		Precondition: 
+		Postcondition: Returns n when the image is n^3 pixels cut into n x n tiles, else 0
+		=============================================== */ 
+		int getVolumeSize();
+		/*	===============================================
+		Desc:	Incremental version of bindTexture3D, for volumes too large to upload in one frame
+		Precondition: 
+		Postcondition: beginTexture3D allocates the texture, then each uploadTexture3DSlices call
+						uploads the next maxSlices slices and returns true when all are done.
+						The texture holds undefined data until then.
+		=============================================== */ 
+		unsigned int beginTexture3D(unsigned int sizeT);
+		bool uploadTexture3DSlices(int maxSlices);
 		void releaseTexture();
 private:
 		std::string magicNumber;	// Used in the header to determine
@@ -78,6 +106,12 @@ private:
 									// etc.
 
 		unsigned int textureID;
+
+		// 3D texture slices waiting to be uploaded, slice after slice
+		std::vector<char> volume;
+		int volumeSize;				// width and height of a slice
+		int volumeDepth;			// number of slices
+		int slicesUploaded;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,312 @@
+#version 330
+
+#define baseBright  vec3(1.26,1.25,1.29)    // base color -- light
+#define baseDark    vec3(0.31,0.31,0.32)    // base color -- dark
+#define lightBright vec3(1.29, 1.17, 1.05)  // light color -- light
+#define lightDark   vec3(0.7,0.75,0.8)      // light color -- dark
+
+uniform int frameCounter;   // incr per frame
+uniform int animationFrame; // drift time, held while progressive refinement accumulates
+uniform sampler3D noiseTex; // noise texture to sample for cloud
+// transmittance toward the light over the cloud box, built on the cpu for an earlier frame
+uniform sampler3D cloudLight;
+uniform vec3 cloudLightShift;   // where the clouds at a point were when the volume was built
+uniform int cloudLightValid;
+// output from ray tracing
+uniform sampler2D distanceMap;
+// max of the noise over cloudGridCells^3 cells of one noise period, for the base layer (r)
+// and the first detail layer (g)
+uniform sampler3D cloudGrid;
+uniform int cloudGridCells;
+uniform int skipEmpty;
+
+in vec3 rayOrigin;  // camera position
+in vec3 rayDirection;   // normalized direction for current ray
+flat in ivec2 cloudPixel;
+flat in ivec2 fullPixel;
+
+uniform sampler2D blueNoise;    // per pixel start offsets
+
+// cloud box and parameters, shared by the cloud and environment passes through the CloudBlock uniform buffer
+layout(std140) uniform CloudBlock {
+	float width;
+	float bottom;
+	float top;
+	float cloudSpeed;
+	float sampleRange;
+	float cloudDensity;
+	float stepSize;     // step size for ray marching near the camera
+	int cloudScale;     // full resolution pixels per cloud pixel, along each axis
+};
+
+layout(location = 0) out vec4 outCloud;
+layout(location = 1) out vec2 outSteps;   // density evaluations and empty cells skipped by this ray
+
+// 3D Noise Function
+float noise(vec3 coord) {
+    return texture(noiseTex, coord).x;  // Sample 3D texture
+}
+
+// Noise texture coordinate of a world position, the clouds drift along (1, -1, 1)
+vec3 getNoiseCoord(vec3 worldPos) {
+    vec3 coord = worldPos * (sampleRange * 0.0001);
+    coord.x += animationFrame * (cloudSpeed * 0.0001);
+    coord.z += animationFrame * (cloudSpeed * 0.0001);
+    coord.y -= animationFrame * (cloudSpeed * 0.0001);
+    return coord;
+}
+
+float getDetailFactor(float distanceFromCamera) {
+    return 1.0 - smoothstep(0.0, 1000.0, distanceFromCamera);
+}
+
+// Generate Cloud Noise based on world position
+// Add detail control based on distance in getCloudNoise function
+float getCloudNoise(vec3 worldPos, float distanceFromCamera) {
+    vec3 coord = getNoiseCoord(worldPos);
+    
+    // Calculate detail level based on distance
+    float detailFactor = getDetailFactor(distanceFromCamera);
+    
+    // Base noise layer
+    float n = noise(coord) * 0.55;
+    
+    // Dynamically add detail layers based on distance
+    if(detailFactor > 0.3) {
+        coord *= 3.0;
+        n += noise(coord) * 0.25 * detailFactor;
+        
+        if(detailFactor > 0.6) {
+            coord *= 3.01;
+            n += noise(coord) * 0.125 * detailFactor;
+            
+            if(detailFactor > 0.8) {
+                coord *= 3.02;
+                n += noise(coord) * 0.0625 * detailFactor;
+            }
+        }
+    }
+    
+    // Control the threshold of the noise
+    float threshold = 0.45;
+    
+    return max(n - threshold, 0.0) * (1.0 / (1.0 - threshold));
+}
+
+
+
+// Compute Density at a given position
+float getDensity(vec3 pos, float distanceFromCamera) {
+    vec3 boxMin = vec3(-width, bottom, -width);
+    vec3 boxMax = vec3(width, top, width);
+    
+    // Increase the width of boundary transition zone
+    float transitionWidth = width * 0.3;
+    float transitionHeight = (top - bottom) * 0.5;
+    
+    // Calculate distance to boundaries
+    float distToEdgeX = min(abs(pos.x - boxMin.x), abs(pos.x - boxMax.x));
+    float distToEdgeZ = min(abs(pos.z - boxMin.z), abs(pos.z - boxMax.z));
+    float distToEdgeY = min(abs(pos.y - boxMin.y), abs(pos.y - boxMax.y));
+    
+    // Calculate boundary weights
+    float horizontalEdgeFade = min(distToEdgeX, distToEdgeZ);
+    float horizontalWeight = smoothstep(0.0, transitionWidth, horizontalEdgeFade);
+
+    float verticalWeight = smoothstep(0.0, transitionHeight, distToEdgeY);
+    
+    float edgeWeight = pow(verticalWeight, 4);
+    
+    // Original height weight calculation
+    float mid = (bottom + top) / 2.0;
+    float h = top - bottom;
+    float heightWeight = 1.0 - 2.0 * abs(mid - pos.y) / h;
+    heightWeight = pow(heightWeight, 0.25);
+    heightWeight = smoothstep(0.0, 1.0, heightWeight);
+    
+    // Get base noise
+    float noise = getCloudNoise(pos, distanceFromCamera);
+    
+    // Weaken noise near boundaries
+    noise *= edgeWeight;
+    
+    float density = noise;
+    
+    // Increase density threshold
+    if(density < 0.01 / cloudDensity) {
+        density = 0.0;
+    }
+    
+    return density;
+}
+// AABB intersection for cloud box
+vec2 intersectionAABB(vec3 boxMin, vec3 boxMax, vec3 origin, vec3 direction) {
+    float tnear = -1e10;
+    float tfar = 1e10;
+
+    for (int i = 0; i < 3; i++) {
+        if (direction[i] != 0.0) {
+            float t1 = (boxMin[i] - origin[i]) / direction[i];
+            float t2 = (boxMax[i] - origin[i]) / direction[i];
+
+            if (t1 > t2) {
+                float temp = t1;
+                t1 = t2;
+                t2 = temp;
+            }
+
+            tnear = max(tnear, t1);
+            tfar = min(tfar, t2);
+
+            if (tnear > tfar || tfar < 0.0) {
+                return vec2(-1.0f); // No intersection
+            }
+        } else {
+            // Ray is parallel to the slabs
+            if (origin[i] < boxMin[i] || origin[i] > boxMax[i]) {
+                return vec2(-1.0f); // Ray misses the box
+            }
+        }
+    }
+
+    return vec2(tnear, tfar);
+}
+
+// Beer-Lambert transmittance from pos to the light
+float getLightTransmittance(vec3 pos) {
+    if (cloudLightValid == 0) {
+        return 1.0;
+    }
+    vec3 boxMin = vec3(-width, bottom, -width);
+    vec3 boxMax = vec3(width, top, width);
+    return texture(cloudLight, (pos + cloudLightShift - boxMin) / (boxMax - boxMin)).r;
+}
+
+// Distance along the ray to the end of the grid cell holding point, or -1 if the cell may
+// hold cloud. getCloudNoise is at most base * 0.55 + detailFactor * (detail * 0.25 + 0.125 + 0.0625)
+// with the noise in [0, 1], and getDensity drops what stays under the threshold plus its cutoff.
+// detailFactor only shrinks further along the ray, so the value at point holds for the whole cell.
+float emptyCellExit(vec3 point, vec3 direction, float distanceFromCamera) {
+    vec3 cellCoord = getNoiseCoord(point) * float(cloudGridCells);
+    ivec3 cell = ivec3(floor(cellCoord));
+    vec2 bounds = texelFetch(cloudGrid, (cell % cloudGridCells + cloudGridCells) % cloudGridCells, 0).rg;
+    float maxNoise = bounds.r * 0.55 + getDetailFactor(distanceFromCamera) * (bounds.g * 0.25 + 0.1875);
+    if (maxNoise > 0.45 + 0.55 * 0.01 / cloudDensity) {
+        return -1.0;
+    }
+
+    // cellCoord moves by direction * sampleRange * 0.0001 * cloudGridCells per world unit
+    vec3 speed = direction * (sampleRange * 0.0001 * float(cloudGridCells));
+    vec3 exit = vec3(1e10);
+    for (int i = 0; i < 3; i++) {
+        if (speed[i] > 0.0) {
+            exit[i] = (float(cell[i]) + 1.0 - cellCoord[i]) / speed[i];
+        }
+        else if (speed[i] < 0.0) {
+            exit[i] = (float(cell[i]) - cellCoord[i]) / speed[i];
+        }
+    }
+    return min(exit.x, min(exit.y, exit.z));
+}
+
+// Fraction of a step the march of this pixel starts late. Blue noise keeps neighbouring pixels
+// far apart, the golden ratio walks every pixel through all offsets over the frames.
+float getStepDither() {
+    float offset = texelFetch(blueNoise, cloudPixel % textureSize(blueNoise, 0), 0).r;
+    return fract(offset + float(frameCounter) * 0.61803398875);
+}
+
+// Cloud rendering function
+vec4 renderCloud(vec3 cameraPosition, vec3 worldPosition, float depth) {
+    vec3 viewDirection = normalize(worldPosition - cameraPosition);
+    outSteps = vec2(0.0);
+
+    vec4 colorSum = vec4(0);
+    
+    // Box boundaries
+    vec3 boxMin = vec3(-width, bottom, -width);
+    vec3 boxMax = vec3(width, top, width);
+
+    float tnear = intersectionAABB(boxMin, boxMax, cameraPosition, viewDirection).x;
+    if (abs(tnear - -1.0f) < 1e-8f) {
+        return vec4(0.0f);
+    }
+
+    // Calculate intersection point
+    vec3 point = cameraPosition + viewDirection * max(tnear, 0.0);
+    float distanceFromCamera = length(point - cameraPosition);
+
+    float len1 = length(point - cameraPosition);     
+    float len2 = length(worldPosition - cameraPosition); 
+    if(len2<len1) {
+        return vec4(0);
+    }
+
+    // Ray marching
+    
+    // 根据距离调整采样步长
+    
+    float adaptiveStepSize = stepSize * (1.0 + smoothstep(0.0, 500.0, distanceFromCamera) * 2.0);
+    float maxDistance = length(vec3(2*width, top-bottom, 2*width));
+    int maxSteps = int(maxDistance / adaptiveStepSize) + 50;
+
+    // densities are opacities for steps of length 0.1, rescale them to the distant, longer steps too
+    float stepScale = adaptiveStepSize / 0.1;
+
+    // dither the start instead of every step, the samples stay evenly spaced along the ray
+    point += viewDirection * (adaptiveStepSize * getStepDither());
+    
+    for (int i = 0; i < maxSteps; i++) {
+        // 使用自适应步长
+        point += viewDirection * adaptiveStepSize;
+        
+
+        if (point.x < boxMin.x || point.x > boxMax.x ||
+            point.y < boxMin.y || point.y > boxMax.y ||
+            point.z < boxMin.z || point.z > boxMax.z) {
+            break;
+        }
+
+        if (depth > 0.0f && 
+            ((point.x - cameraPosition.x) / viewDirection.x > depth || 
+            (point.y - cameraPosition.y) / viewDirection.y > depth || 
+            (point.z - cameraPosition.z) / viewDirection.z > depth)) {
+            break;
+        }
+
+        float currentDistance = length(point - cameraPosition);
+
+        // leap to the end of cells the noise can not produce cloud in,
+        // one step short so the next step lands just inside the following cell
+        if (skipEmpty != 0) {
+            float exit = emptyCellExit(point, viewDirection, currentDistance);
+            if (exit >= 0.0) {
+                point += viewDirection * max(exit - adaptiveStepSize, 0.0);
+                outSteps.y += 1.0;
+                continue;
+            }
+        }
+
+        float density = getDensity(point, currentDistance);
+        outSteps.x += 1.0;
+
+        density *= 1.5;
+        float alpha = 1.0 - pow(1.0 - min(density, 1.0), stepScale);
+
+        vec3 base = mix(baseBright, baseDark, density) * alpha;
+        vec3 light = mix(lightDark, lightBright, getLightTransmittance(point));
+        vec4 color = vec4(base * light, alpha);
+        colorSum = color * (1.0 - colorSum.a) + colorSum;
+
+        if (colorSum.a > 0.98) {
+            break;
+        }
+    }
+    return colorSum;
+}
+
+void main()
+{
+    float depth = texelFetch(distanceMap, fullPixel, 0).r;
+    outCloud = renderCloud(rayOrigin, rayOrigin + rayDirection * 1000, depth);
+}
@@ -0,0 +1,163 @@
+#version 330
+
+// Temporal resolve of the cloud target.
+// Pixels marched this frame are taken as they are, the others reproject the previous
+// resolved frame through the previous camera and clamp it to the freshly marched neighbours.
+
+const float PI = 3.14159265359;
+
+uniform sampler2D marchMap;         // this frame's marched pixels
+uniform sampler2D historyMap;       // resolved clouds of the previous frame
+uniform sampler2D historyDepthMap;  // scene depth behind them
+uniform sampler2D distanceMap;      // full resolution scene depth
+uniform int historyValid;
+
+uniform ivec2 marchSize;
+uniform int marchStride;
+uniform ivec2 marchOffset;
+
+// previous camera
+uniform vec3 prevEyePosition;
+uniform vec3 prevLookVec;
+uniform vec3 prevUpVec;
+uniform ivec2 cloudSize;
+uniform float driftFrames;      // animation frames since the previous frame, 0 while progressive refinement holds the time
+
+// camera, shared by every pass through the CameraBlock uniform buffer
+layout(std140) uniform CameraBlock {
+	vec3 eyePosition;
+	float viewAngle;
+	vec3 lookVec;
+	float nearPlane;
+	vec3 upVec;
+	float screenWidth;
+	float screenHeight;
+	vec2 pixelJitter;   // sub-pixel ray offset of progressive refinement
+};
+
+// cloud box and parameters, shared by the cloud and environment passes through the CloudBlock uniform buffer
+layout(std140) uniform CloudBlock {
+	float width;
+	float bottom;
+	float top;
+	float cloudSpeed;
+	float sampleRange;
+	float cloudDensity;
+	float stepSize;     // step size for ray marching near the camera
+	int cloudScale;     // full resolution pixels per cloud pixel, along each axis
+};
+
+in vec3 rayOrigin;
+in vec3 rayDirection;
+flat in ivec2 cloudPixel;
+flat in ivec2 fullPixel;
+
+layout(location = 0) out vec4 outCloud;
+layout(location = 1) out float outDepth;   // scene depth the clouds were marched against
+
+// AABB intersection for cloud box
+vec2 intersectionAABB(vec3 boxMin, vec3 boxMax, vec3 origin, vec3 direction) {
+    float tnear = -1e10;
+    float tfar = 1e10;
+
+    for (int i = 0; i < 3; i++) {
+        if (direction[i] != 0.0) {
+            float t1 = (boxMin[i] - origin[i]) / direction[i];
+            float t2 = (boxMax[i] - origin[i]) / direction[i];
+
+            if (t1 > t2) {
+                float temp = t1;
+                t1 = t2;
+                t2 = temp;
+            }
+
+            tnear = max(tnear, t1);
+            tfar = min(tfar, t2);
+
+            if (tnear > tfar || tfar < 0.0) {
+                return vec2(-1.0f); // No intersection
+            }
+        } else {
+            // Ray is parallel to the slabs
+            if (origin[i] < boxMin[i] || origin[i] > boxMax[i]) {
+                return vec2(-1.0f); // Ray misses the box
+            }
+        }
+    }
+
+    return vec2(tnear, tfar);
+}
+
+// Full resolution pixel position of p as seen by the previous camera, negative when behind it
+vec2 previousPixel(vec3 p) {
+    vec3 d = p - prevEyePosition;
+    float z = dot(d, prevLookVec);
+    if (z <= 0.0) {
+        return vec2(-1.0);
+    }
+    vec3 u = cross(prevLookVec, prevUpVec);
+    float H = nearPlane * tan(viewAngle / 180.0 * PI / 2.0);
+    float W = H * screenWidth / screenHeight;
+    float a = nearPlane * dot(d, u) / z;
+    float b = nearPlane * dot(d, prevUpVec) / z;
+    return vec2((a + W) / (2.0 * W) * screenWidth, (b + H) / (2.0 * H) * screenHeight);
+}
+
+bool depthMatches(float depth, float historyDepth) {
+    if (depth <= 0.0 || historyDepth <= 0.0) {
+        return depth <= 0.0 && historyDepth <= 0.0;
+    }
+    return abs(depth - historyDepth) < 0.1 * depth;
+}
+
+void main()
+{
+    float depth = texelFetch(distanceMap, fullPixel, 0).r;
+    outDepth = depth;
+
+    if (cloudPixel % marchStride == marchOffset) {
+        outCloud = texelFetch(marchMap, cloudPixel / marchStride, 0);
+        return;
+    }
+
+    // the four marched pixels around this one, for the fallback and the history clamp
+    vec2 position = vec2(cloudPixel - marchOffset) / float(marchStride);
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+    vec4 fresh = vec4(0.0);
+    vec4 freshMin = vec4(1e10);
+    vec4 freshMax = vec4(-1e10);
+    for (int j = 0; j <= 1; j++) {
+        for (int i = 0; i <= 1; i++) {
+            vec4 c = texelFetch(marchMap, clamp(base + ivec2(i, j), ivec2(0), marchSize - 1), 0);
+            fresh += c * (i == 0 ? 1.0 - f.x : f.x) * (j == 0 ? 1.0 - f.y : f.y);
+            freshMin = min(freshMin, c);
+            freshMax = max(freshMax, c);
+        }
+    }
+    outCloud = fresh;
+    if (historyValid == 0) {
+        return;
+    }
+
+    // reproject the point where this ray enters the cloud box
+    vec2 box = intersectionAABB(vec3(-width, bottom, -width), vec3(width, top, width), rayOrigin, rayDirection);
+    if (abs(box.x - -1.0f) < 1e-8f) {
+        return;
+    }
+    float t = box.x > 0.0 ? box.x : min(box.y, 100.0);
+    // the noise scrolls by cloudSpeed / sampleRange world units per animation frame along (1, -1, 1)
+    vec3 drift = vec3(1.0, -1.0, 1.0) * (driftFrames * cloudSpeed / max(sampleRange, 1e-3));
+    vec2 historyPixel = (previousPixel(rayOrigin + rayDirection * t + drift) - float(cloudScale / 2)) / float(cloudScale);
+    if (any(lessThan(historyPixel, vec2(0.0))) || any(greaterThan(historyPixel, vec2(cloudSize - 1)))) {
+        return;
+    }
+    vec2 uv = (historyPixel + 0.5) / vec2(cloudSize);
+    if (!depthMatches(depth, texelFetch(historyDepthMap, ivec2(historyPixel + 0.5), 0).r)) {
+        return;
+    }
+
+    // neighbourhood clamp rejects history the fresh samples disagree with
+    vec4 spread = (freshMax - freshMin) * 0.25 + 0.02;
+    outCloud = clamp(texture(historyMap, uv), freshMin - spread, freshMax + spread);
+}
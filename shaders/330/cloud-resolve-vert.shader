@@ -0,0 +1,57 @@
+#version 330 core
+
+// const
+const float PI = 3.14159265359;
+
+// Uniform
+// camera, shared by every pass through the CameraBlock uniform buffer
+layout(std140) uniform CameraBlock {
+	vec3 eyePosition;
+	float viewAngle;
+	vec3 lookVec;
+	float nearPlane;
+	vec3 upVec;
+	float screenWidth;
+	float screenHeight;
+	vec2 pixelJitter;   // sub-pixel ray offset of progressive refinement
+};
+// cloud box and parameters, shared by the cloud and environment passes through the CloudBlock uniform buffer
+layout(std140) uniform CloudBlock {
+	float width;
+	float bottom;
+	float top;
+	float cloudSpeed;
+	float sampleRange;
+	float cloudDensity;
+	float stepSize;     // step size for ray marching near the camera
+	int cloudScale;     // full resolution pixels per cloud pixel, along each axis
+};
+uniform ivec2 cloudSize;    // size of the cloud target
+
+// outputs
+out vec3 rayOrigin;     // ray origin (eye position)
+out vec3 rayDirection;  // ray dir
+flat out ivec2 cloudPixel;
+flat out ivec2 fullPixel;   // full resolution pixel this cloud pixel stands for
+
+void main() {
+	// one point per cloud pixel
+	cloudPixel = ivec2(gl_VertexID % cloudSize.x, gl_VertexID / cloudSize.x);
+	vec2 ndc = (vec2(cloudPixel) + 0.5) / vec2(cloudSize) * 2.0 - 1.0;
+	gl_Position = vec4(ndc, 0.0, 1.0);
+
+	fullPixel = min(cloudPixel * cloudScale + cloudScale / 2, ivec2(screenWidth, screenHeight) - 1);
+	vec2 pixelIndex = vec2(fullPixel);
+
+    vec3 Q = eyePosition + lookVec * nearPlane;	// filmPosition
+	float theta = viewAngle / 180.0f * PI;
+	float H = nearPlane * tan(theta / 2.0f);
+	float W = H * screenWidth / screenHeight;
+	float a = -W + 2 * W * (pixelIndex.x / screenWidth);
+	float b = -H + 2 * H * (pixelIndex.y / screenHeight);
+	vec3 u = cross(lookVec, upVec);
+	vec3 v = upVec;
+	vec3 S = Q + a * u + b * v;
+	rayOrigin = eyePosition;
+	rayDirection = normalize(S - eyePosition);
+}
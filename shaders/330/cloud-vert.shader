@@ -0,0 +1,61 @@
+#version 330 core
+
+// const
+const float PI = 3.14159265359;
+
+// Uniform
+// camera, shared by every pass through the CameraBlock uniform buffer
+layout(std140) uniform CameraBlock {
+	vec3 eyePosition;
+	float viewAngle;
+	vec3 lookVec;
+	float nearPlane;
+	vec3 upVec;
+	float screenWidth;
+	float screenHeight;
+	vec2 pixelJitter;   // sub-pixel ray offset of progressive refinement
+};
+// cloud box and parameters, shared by the cloud and environment passes through the CloudBlock uniform buffer
+layout(std140) uniform CloudBlock {
+	float width;
+	float bottom;
+	float top;
+	float cloudSpeed;
+	float sampleRange;
+	float cloudDensity;
+	float stepSize;     // step size for ray marching near the camera
+	int cloudScale;     // full resolution pixels per cloud pixel, along each axis
+};
+uniform ivec2 marchSize;    // pixels marched this frame
+uniform int marchStride;    // one cloud pixel out of marchStride x marchStride is marched per frame
+uniform ivec2 marchOffset;  // which one, cycles in bayer order
+
+// outputs
+out vec3 rayOrigin;     // ray origin (eye position)
+out vec3 rayDirection;  // ray dir
+flat out ivec2 cloudPixel;
+flat out ivec2 fullPixel;   // full resolution pixel this cloud pixel stands for
+
+void main() {
+	// one point per marched pixel, indexed by gl_VertexID instead of a vertex buffer
+	ivec2 marchPixel = ivec2(gl_VertexID % marchSize.x, gl_VertexID / marchSize.x);
+	vec2 ndc = (vec2(marchPixel) + 0.5) / vec2(marchSize) * 2.0 - 1.0;
+	gl_Position = vec4(ndc, 0.0, 1.0);
+	cloudPixel = marchPixel * marchStride + marchOffset;
+
+	// the ray goes through the full resolution pixel at the center of the block
+	fullPixel = min(cloudPixel * cloudScale + cloudScale / 2, ivec2(screenWidth, screenHeight) - 1);
+	vec2 pixelIndex = vec2(fullPixel) + pixelJitter * float(cloudScale);
+
+    vec3 Q = eyePosition + lookVec * nearPlane;	// filmPosition
+	float theta = viewAngle / 180.0f * PI;
+	float H = nearPlane * tan(theta / 2.0f);
+	float W = H * screenWidth / screenHeight;
+	float a = -W + 2 * W * (pixelIndex.x / screenWidth);
+	float b = -H + 2 * H * (pixelIndex.y / screenHeight);
+	vec3 u = cross(lookVec, upVec);
+	vec3 v = upVec;
+	vec3 S = Q + a * u + b * v;
+	rayOrigin = eyePosition;
+	rayDirection = normalize(S - eyePosition);
+}
@@ -6,32 +6,43 @@
 #define lightDark   vec3(0.7,0.75,0.8)      // light color -- dark
 
 uniform int frameCounter;   // incr per frame
-uniform sampler3D noiseTex; // noise texture to sample for cloud
 uniform sampler2D seaTex;
 uniform sampler2D seaNormalTex;
-uniform vec3 lightPos;  // light position in world space
-uniform samplerBuffer worleyPoints; // Worley points texture for cloud
+layout(std140) uniform LightBlock {
+	vec3 lightPos;  // light position in world space
+};
 // output from ray tracing
 uniform sampler2D colorMap;
 uniform sampler2D distanceMap;
+// low resolution clouds from the cloud pass
+uniform sampler2D cloudMap;
+uniform sampler2D cloudDepthMap;
+uniform vec2 framebufferSize;
+// cost view: 0 shows the image, 1 - 3 a counter of costMap, 4 the cloud steps of cloudStepsMap
+uniform sampler2D costMap;
+uniform sampler2D cloudStepsMap;
+uniform int costView;
+uniform float costScale;    // count shown as red
+
+// cloud box and parameters, shared by the cloud and environment passes through the CloudBlock uniform buffer
+layout(std140) uniform CloudBlock {
+	float width;
+	float bottom;
+	float top;
+	float cloudSpeed;
+	float sampleRange;
+	float cloudDensity;
+	float stepSize;     // step size for ray marching near the camera
+	int cloudScale;     // full resolution pixels per cloud pixel, along each axis
+};
 
 in vec3 pixelColor; // some background calculated by pixel(i, j)
 in vec3 rayOrigin;  // camera position
-in vec3 rayDirection;   // normalized direction for current ray
+in vec3 rayVector;  // direction for current ray, not normalized
 in vec2 pixelCoords;    // pixel coords
 
-const float stepSize = 0.1;   // step size for ray marching
 const int MAX_STACK_SIZE = 1000;
 
-// cloud box
-uniform float bottom;
-uniform float top;
-uniform float width;
-
-// cloud parameters
-uniform float cloudSpeed;
-uniform float cloudDensity;
-uniform float sampleRange;
 out vec4 outputColor;
 
 // sea box
@@ -57,95 +68,7 @@ vec4 debug(float value, float minValue, float maxValue) {
 }
 
 
-// 3D Noise Function
-float noise(vec3 coord) {
-    return texture(noiseTex, coord).x;  // Sample 3D texture
-}
-
-// Generate Cloud Noise based on world position
-// Add detail control based on distance in getCloudNoise function
-float getCloudNoise(vec3 worldPos, float distanceFromCamera) {
-    vec3 coord = worldPos * (sampleRange * 0.0001);
-    coord.x += frameCounter * (cloudSpeed * 0.0001);
-    coord.z += frameCounter * (cloudSpeed * 0.0001);
-    coord.y -= frameCounter * (cloudSpeed * 0.0001);
-
-    
-    // Calculate detail level based on distance
-    float detailFactor = 1.0 - smoothstep(0.0, 1000.0, distanceFromCamera);
-    
-    // Base noise layer
-    float n = noise(coord) * 0.55;
-    
-    // Dynamically add detail layers based on distance
-    if(detailFactor > 0.3) {
-        coord *= 3.0;
-        n += noise(coord) * 0.25 * detailFactor;
-        
-        if(detailFactor > 0.6) {
-            coord *= 3.01;
-            n += noise(coord) * 0.125 * detailFactor;
-            
-            if(detailFactor > 0.8) {
-                coord *= 3.02;
-                n += noise(coord) * 0.0625 * detailFactor;
-            }
-        }
-    }
-    
-    // Control the threshold of the noise
-    float threshold = 0.45;
-    
-    return max(n - threshold, 0.0) * (1.0 / (1.0 - threshold));
-}
-
-
-
-// Compute Density at a given position
-float getDensity(vec3 pos, float distanceFromCamera) {
-    vec3 boxMin = vec3(-width, bottom, -width);
-    vec3 boxMax = vec3(width, top, width);
-    
-    // Increase the width of boundary transition zone
-    float transitionWidth = width * 0.3;
-    float transitionHeight = (top - bottom) * 0.5;
-    
-    // Calculate distance to boundaries
-    float distToEdgeX = min(abs(pos.x - boxMin.x), abs(pos.x - boxMax.x));
-    float distToEdgeZ = min(abs(pos.z - boxMin.z), abs(pos.z - boxMax.z));
-    float distToEdgeY = min(abs(pos.y - boxMin.y), abs(pos.y - boxMax.y));
-    
-    // Calculate boundary weights
-    float horizontalEdgeFade = min(distToEdgeX, distToEdgeZ);
-    float horizontalWeight = smoothstep(0.0, transitionWidth, horizontalEdgeFade);
-
-    float verticalWeight = smoothstep(0.0, transitionHeight, distToEdgeY);
-    
-    float edgeWeight = pow(verticalWeight, 4);
-    
-    // Original height weight calculation
-    float mid = (bottom + top) / 2.0;
-    float h = top - bottom;
-    float heightWeight = 1.0 - 2.0 * abs(mid - pos.y) / h;
-    heightWeight = pow(heightWeight, 0.25);
-    heightWeight = smoothstep(0.0, 1.0, heightWeight);
-    
-    // Get base noise
-    float noise = getCloudNoise(pos, distanceFromCamera);
-    
-    // Weaken noise near boundaries
-    noise *= edgeWeight;
-    
-    float density = noise;
-    
-    // Increase density threshold
-    if(density < 0.01 / cloudDensity) {
-        density = 0.0;
-    }
-    
-    return density;
-}
-// AABB intersection for cloud box
+// AABB intersection
 vec2 intersectionAABB(vec3 boxMin, vec3 boxMax, vec3 origin, vec3 direction) {
     float tnear = -1e10;
     float tfar = 1e10;
@@ -178,88 +101,6 @@ vec2 intersectionAABB(vec3 boxMin, vec3 boxMax, vec3 origin, vec3 direction) {
     return vec2(tnear, tfar);
 }
 
-// Generate smooth noise-based jitter
-float generateStepJitter(vec3 point, float frequency) {
-    return texture(noiseTex, point * frequency).r; // Sample 3D noise
-}
-
-// Cloud rendering function
-vec4 renderCloud(vec3 cameraPosition, vec3 worldPosition, float depth) {
-    vec3 viewDirection = normalize(worldPosition - cameraPosition);
-
-    vec4 colorSum = vec4(0);
-    
-    // Box boundaries
-    vec3 boxMin = vec3(-width, bottom, -width);
-    vec3 boxMax = vec3(width, top, width);
-
-    float tnear = intersectionAABB(boxMin, boxMax, cameraPosition, viewDirection).x;
-    if (abs(tnear - -1.0f) < 1e-8f) {
-        return vec4(0.0f);
-    }
-
-    // Calculate intersection point
-    vec3 point = cameraPosition + viewDirection * max(tnear, 0.0);
-    float distanceFromCamera = length(point - cameraPosition);
-
-    float len1 = length(point - cameraPosition);     
-    float len2 = length(worldPosition - cameraPosition); 
-    if(len2<len1) {
-        return vec4(0);
-    }
-
-    // Ray marching
-    
-    // 根据距离调整采样步长
-    
-    float adaptiveStepSize = stepSize * (1.0 + smoothstep(0.0, 500.0, distanceFromCamera) * 2.0);
-    float maxDistance = length(vec3(2*width, top-bottom, 2*width));
-    int maxSteps = int(maxDistance / adaptiveStepSize) + 50;
-    
-    for (int i = 0; i < maxSteps; i++) {
-        float jitter = generateStepJitter(point, 0.3) * 0.1;
-        
-        // 使用自适应步长
-        vec3 stepWithJitter = viewDirection * (adaptiveStepSize * (1.0 + jitter));
-        point += stepWithJitter;
-        
-
-        if (point.x < boxMin.x || point.x > boxMax.x ||
-            point.y < boxMin.y || point.y > boxMax.y ||
-            point.z < boxMin.z || point.z > boxMax.z) {
-            break;
-        }
-
-        if (depth > 0.0f && 
-            ((point.x - cameraPosition.x) / viewDirection.x > depth || 
-            (point.y - cameraPosition.y) / viewDirection.y > depth || 
-            (point.z - cameraPosition.z) / viewDirection.z > depth)) {
-            break;
-        }
-
-        float currentDistance = length(point - cameraPosition);
-        float density = getDensity(point, currentDistance);
-
-        density *= 1.5;
-        vec3 L = normalize(lightPos - point);
-        
-        // 根据距离调整光照采样
-        float lightSampleDist = 5.0 + currentDistance * 0.1;
-        float lightDensity = getDensity(point + L * lightSampleDist, currentDistance);
-        float delta = clamp(density - lightDensity, 0.0, 1.0);
-
-        vec3 base = mix(baseBright, baseDark, density) * density;
-        vec3 light = mix(lightDark, lightBright, delta);
-        vec4 color = vec4(base * light, density);
-        colorSum = color * (1.0 - colorSum.a) + colorSum;
-
-        if (colorSum.a > 0.98) {
-            break;
-        }
-    }
-    return colorSum;
-}
-
 vec4 renderSea(vec3 cameraPosition, vec3 worldPosition)
 {
     // vertex
@@ -287,11 +128,60 @@ vec4 renderSea(vec3 cameraPosition, vec3 worldPosition)
     return texColor * combinedDiffuse;
 }
 
+// Bilateral weight, a cloud sample marched against a different surface than this pixel barely counts
+float depthWeight(float pixelDepth, float cloudDepth) {
+    float a = pixelDepth > 0.0 ? pixelDepth : 1e5;  // no hit, treat as far away
+    float b = cloudDepth > 0.0 ? cloudDepth : 1e5;
+    return 1.0 / (1e-3 + abs(a - b) / a);
+}
+
+// Depth aware upsampling of the cloud target. Cloud pixel c was marched through render resolution
+// pixel c * cloudScale + cloudScale / 2, the four around this pixel are blended bilinearly
+// and weighted by how close their depth is to this pixel's depth.
+// pixel is in render resolution pixels, fractional when the window is larger.
+vec4 upsampleCloud(vec2 pixel, float depth) {
+    ivec2 cloudSize = textureSize(cloudMap, 0);
+    vec2 position = (pixel - float(cloudScale / 2)) / float(cloudScale);
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+
+    vec4 colorSum = vec4(0.0);
+    float weightSum = 0.0;
+    for (int j = 0; j <= 1; j++) {
+        for (int i = 0; i <= 1; i++) {
+            ivec2 tap = clamp(base + ivec2(i, j), ivec2(0), cloudSize - 1);
+            float bilinear = (i == 0 ? 1.0 - f.x : f.x) * (j == 0 ? 1.0 - f.y : f.y);
+            float weight = (bilinear + 1e-4) * depthWeight(depth, texelFetch(cloudDepthMap, tap, 0).r);
+            colorSum += texelFetch(cloudMap, tap, 0) * weight;
+            weightSum += weight;
+        }
+    }
+    return colorSum / weightSum;
+}
+
+// False colour ramp of the cost view over [0, 1]: black, blue, cyan, green, yellow, red
+vec3 heatmap(float x) {
+    const vec3 ramp[6] = vec3[](vec3(0.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 1.0),
+                                vec3(0.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0));
+    float position = clamp(x, 0.0, 1.0) * 5.0;
+    int index = min(int(position), 4);
+    return mix(ramp[index], ramp[index + 1], position - float(index));
+}
+
 void main()
 {
-    vec4 color = vec4(texture(colorMap, pixelCoords).rgb, 1.0f);
-    float depth = texture(distanceMap, pixelCoords).r;
-	vec4 cloudColor = renderCloud(rayOrigin,  rayOrigin + rayDirection * 1000, depth);
+    // targets are sampled at texel centers, the color bilinearly when upscaled to the window
+    vec2 targetCoords = pixelCoords + 0.5 / framebufferSize;
+    if (costView > 0) {
+        // density evaluations and skipped cells of the cloud ray marched nearest to this pixel
+        float cost = costView == 4 ? dot(texture(cloudStepsMap, targetCoords).rg, vec2(1.0))
+                                   : texture(costMap, targetCoords)[costView - 1];
+        outputColor = vec4(heatmap(cost / costScale), 1.0);
+        return;
+    }
+    vec4 color = vec4(texture(colorMap, targetCoords).rgb, 1.0f);
+    float depth = texture(distanceMap, targetCoords).r;
+	vec4 cloudColor = upsampleCloud(pixelCoords * framebufferSize, depth);
     color = mix(color, cloudColor, cloudColor.a);
     outputColor = color;
 }
@@ -26,27 +26,35 @@ uniform int rootIndex;  // index for kdtree root node
 
 uniform int frameCounter;   // incr per frame
 
-uniform vec3 lightPos;  // light position in world space
+layout(std140) uniform LightBlock {
+	vec3 lightPos;  // light position in world space
+};
 
 uniform vec3 meshTrans; // mesh translation
 
 in vec3 pixelColor; // some background calculated by pixel(i, j)
 in vec3 rayOrigin;  // camera position
-in vec3 rayDirection;   // normalized direction for current ray
+in vec3 rayVector;  // direction for current ray, normalized in main
 
 const float PI = 3.14159265359;
 const int MAX_STACK_SIZE = 1000;
 
-#define MAX_WAVES 219
+// work done for this pixel by every ray, primary, shadow and reflection
+int nodesVisited = 0;
+int trianglesTested = 0;
+int seaSteps = 0;
 
-uniform int waveCount;
-uniform vec2 waveDir[MAX_WAVES];
-uniform float waveOmega[MAX_WAVES];
-uniform float waveAmplitude[MAX_WAVES];
-uniform float wavePhaseOffset[MAX_WAVES];
+// FFT ocean patch, updated every frame by MyGLCanvas::updateOcean
+uniform sampler2D oceanHeight;          // surface height above each grid point
+uniform sampler2D oceanHeightBounds;    // min / max height of 2^level x 2^level cells, one mip per level
+uniform sampler2D oceanNormal;
+uniform int oceanLevels;                // mip count, the last level is one cell for the whole patch
+uniform float oceanPatchSize;           // world size of one repeat of the maps
+uniform float oceanHeightScale;
 
 layout(location = 0) out vec4 outColor;
 layout(location = 1) out float outDistance;
+layout(location = 2) out vec4 outCost;      // kd-tree nodes visited, triangles tested and sea steps, for the cost view
 // out vec4 outputColor;
 
 struct mesh {
@@ -122,16 +130,39 @@ float intersectionTriangle(mesh m, vec3 origin, vec3 direction) {
     return -1.0f;
 }
 
+// GLSL 3.30 only allows constant indexes into sampler arrays, so the buffer is picked by a switch
+vec4 fetchMesh(int bufferIdx, int texel) {
+    switch (bufferIdx) {
+        case 0: return texelFetch(meshBuffer[0], texel);
+        case 1: return texelFetch(meshBuffer[1], texel);
+        case 2: return texelFetch(meshBuffer[2], texel);
+        case 3: return texelFetch(meshBuffer[3], texel);
+        case 4: return texelFetch(meshBuffer[4], texel);
+        default: return texelFetch(meshBuffer[5], texel);
+    }
+}
+
+vec4 fetchTree(int bufferIdx, int texel) {
+    switch (bufferIdx) {
+        case 0: return texelFetch(treeBuffer[0], texel);
+        case 1: return texelFetch(treeBuffer[1], texel);
+        case 2: return texelFetch(treeBuffer[2], texel);
+        case 3: return texelFetch(treeBuffer[3], texel);
+        case 4: return texelFetch(treeBuffer[4], texel);
+        default: return texelFetch(treeBuffer[5], texel);
+    }
+}
+
 mesh getMesh(int index) {
     int bufferIdx = index / maxTrianglesPerBuffer;
     int localIdx = index % maxTrianglesPerBuffer;
     mesh ret;
-    ret.v1 = texelFetch(meshBuffer[bufferIdx], 6 * localIdx).rgb;
-    ret.v2 = texelFetch(meshBuffer[bufferIdx], 6 * localIdx + 1).rgb;
-    ret.v3 = texelFetch(meshBuffer[bufferIdx], 6 * localIdx + 2).rgb;
-    ret.faceNormal = texelFetch(meshBuffer[bufferIdx], 6 * localIdx + 3).rgb;
-    ret.diffuseColor = texelFetch(meshBuffer[bufferIdx], 6 * localIdx + 4).rgb;
-    ret.type = texelFetch(meshBuffer[bufferIdx], 6 * localIdx + 5).rgb;
+    ret.v1 = fetchMesh(bufferIdx, 6 * localIdx).rgb;
+    ret.v2 = fetchMesh(bufferIdx, 6 * localIdx + 1).rgb;
+    ret.v3 = fetchMesh(bufferIdx, 6 * localIdx + 2).rgb;
+    ret.faceNormal = fetchMesh(bufferIdx, 6 * localIdx + 3).rgb;
+    ret.diffuseColor = fetchMesh(bufferIdx, 6 * localIdx + 4).rgb;
+    ret.type = fetchMesh(bufferIdx, 6 * localIdx + 5).rgb;
     return ret;
 }
 
@@ -139,13 +170,13 @@ node getNode(int index) {
     int bufferIdx = index / maxNodesPerBuffer;
     int localIdx = index % maxNodesPerBuffer;
     node ret;
-    vec3 v1 = texelFetch(treeBuffer[bufferIdx], 5 * localIdx).rgb;
+    vec3 v1 = fetchTree(bufferIdx, 5 * localIdx).rgb;
     ret.left = int(round(v1.x));
     ret.right = int(round(v1.y));
-    ret.min_xyz = texelFetch(treeBuffer[bufferIdx], 5 * localIdx + 1).rgb;
-    ret.max_xyz = texelFetch(treeBuffer[bufferIdx], 5 * localIdx + 2).rgb;
-    vec3 v4 = texelFetch(treeBuffer[bufferIdx], 5 * localIdx + 3).rgb;
-    vec3 v5 = texelFetch(treeBuffer[bufferIdx], 5 * localIdx + 4).rgb;
+    ret.min_xyz = fetchTree(bufferIdx, 5 * localIdx + 1).rgb;
+    ret.max_xyz = fetchTree(bufferIdx, 5 * localIdx + 2).rgb;
+    vec3 v4 = fetchTree(bufferIdx, 5 * localIdx + 3).rgb;
+    vec3 v5 = fetchTree(bufferIdx, 5 * localIdx + 4).rgb;
     ret.meshes[0] = int(round(v4.x));
     ret.meshes[1] = int(round(v4.y));
     ret.meshes[2] = int(round(v4.z));
@@ -160,6 +191,7 @@ vec2 intersection(vec3 origin, vec3 direction) {
     float t = -1.0f;
     for (int i = 0; i < meshSize; i++) {
         mesh m = getMesh(i);
+        trianglesTested++;
         float tmpt = intersectionTriangle(m, origin, direction);
         if (t < 0.0f) {
             if (tmpt > 0.0f) {
@@ -192,11 +224,13 @@ vec2 intersectionKDTree(vec3 origin, vec3 direction) {
         // pop top
         int currentIndex = stack[--stackSize];
         node n = getNode(currentIndex);
+        nodesVisited++;
 
         if (n.left == -1) { // leaf node
             for (int j = 0; j < 6; j++) {
                 if (n.meshes[j] == -1) break; // no more mesh
                 mesh m = getMesh(n.meshes[j]);
+                trianglesTested++;
                 float tmpt = intersectionTriangle(m, origin, direction);
                 if (t < 0.0f) {
                     if (tmpt > 0.0f) {
@@ -246,51 +280,128 @@ vec4 calculateRGB(vec3 origin, vec3 direction) {
 }
 
 // sea box
-#define sea_bottom -5
-#define sea_top -4
 #define sea_width 200
+#define sea_level -4.0
+#define MAX_OCEAN_STEPS 160
+
+
 
+float oceanGridHeight(ivec2 point, int size) {
+    return texelFetch(oceanHeight, point & (size - 1), 0).r * oceanHeightScale + sea_level;
+}
 
+// First t in [t0, t1] where the ray meets the bilinear patch of grid cell 'cell', or -1.
+// Along the ray the patch height is quadratic in t, so the crossing is solved exactly.
+float intersectOceanCell(ivec2 cell, vec3 origin, vec3 direction, float toGrid, float t0, float t1) {
+    int size = textureSize(oceanHeight, 0).x;
+    float h00 = oceanGridHeight(cell, size);
+    float h10 = oceanGridHeight(cell + ivec2(1, 0), size);
+    float h01 = oceanGridHeight(cell + ivec2(0, 1), size);
+    float h11 = oceanGridHeight(cell + ivec2(1, 1), size);
+
+    // H(f) = h00 + b f.x + c f.y + e f.x f.y, f = position inside the cell
+    float b = h10 - h00;
+    float c = h01 - h00;
+    float e = h00 - h10 - h01 + h11;
+    vec2 f0 = (origin.xz + direction.xz * t0) * toGrid - 0.5 - vec2(cell);
+    vec2 df = direction.xz * toGrid;
+
+    // ray height - surface height = A s^2 + B s + C, s = t - t0
+    float C = origin.y + direction.y * t0 - (h00 + b * f0.x + c * f0.y + e * f0.x * f0.y);
+    float B = direction.y - (b * df.x + c * df.y + e * (f0.x * df.y + f0.y * df.x));
+    float A = -e * df.x * df.y;
+    if (C <= 0.0) {
+        return t0;
+    }
 
-// The wave height is calculated using the equation:
-//     H = A * sin(k · x - ωt + φ)
-// where A is the amplitude, k is the wave direction, ω is the frequency, and φ is the phase offset.
-float calculateWaveHeight(vec2 pos, float t) {
-    float height = 0.0;
-    for (int i = 0; i < waveCount; i++) {
-        float phase = dot(waveDir[i], pos) * waveOmega[i] - waveOmega[i]*t + wavePhaseOffset[i];
-        height += waveAmplitude[i] * sin(phase);
+    float s = -1.0;
+    if (abs(A) < 1e-8) {
+        if (B < 0.0) {
+            s = -C / B;
+        }
     }
-    return height;
+    else {
+        float disc = B * B - 4.0 * A * C;
+        if (disc >= 0.0) {
+            float root = sqrt(disc);
+            float s1 = (-B - root) / (2.0 * A);
+            float s2 = (-B + root) / (2.0 * A);
+            float first = min(s1, s2);
+            s = first >= 0.0 ? first : max(s1, s2);
+        }
+    }
+    return (s >= 0.0 && s <= t1 - t0) ? t0 + s : -1.0;
 }
 
-// This gradient(slope of the surface) defines the normal vector.
-void computeNormalFromHeight(vec2 pos, float t, out float H, out vec3 N) {
-    float epsilon = 0.001;
-    float H0 = calculateWaveHeight(pos, t);
-    float Hx = (calculateWaveHeight(pos + vec2(epsilon,0), t) - calculateWaveHeight(pos - vec2(epsilon,0), t)) / (2.0*epsilon);
-    float Hz = (calculateWaveHeight(pos + vec2(0,epsilon), t) - calculateWaveHeight(pos - vec2(0,epsilon), t)) / (2.0*epsilon);
-    H = H0;
-    N = normalize(vec3(-Hx, abs(1.0), -Hz));
+// Marches the tiled ocean heightfield through its min / max pyramid (a maximum mipmap quadtree).
+// A node the ray passes above or below is skipped whole, otherwise the march descends into it,
+// and it climbs again once it leaves the parent, so steps grow with log2 of the grid size.
+// Returns the hit distance, or -1 for no hit before tMax (ignored when < 0). A march that runs
+// out of steps returns the distance it reached.
+float intersectOcean(vec3 origin, vec3 direction, float tMax) {
+    int top = oceanLevels - 1;
+    vec2 rootBounds = texelFetch(oceanHeightBounds, ivec2(0), top).rg * oceanHeightScale + sea_level;
+    vec2 slab = intersectionAABB(vec3(-sea_width, rootBounds.x, -sea_width), vec3(sea_width, rootBounds.y, sea_width), origin, direction);
+    if (abs(slab.x - -1.0f) < 1e-8f) {
+        return -1.0;
+    }
+    float t = max(slab.x, 0.0);
+    float tEnd = tMax > 0.0 ? min(slab.y, tMax) : slab.y;
+
+    float toGrid = float(textureSize(oceanHeight, 0).x) / oceanPatchSize;
+    vec2 df = direction.xz * toGrid;
+    int level = top;
+    for (int i = 0; i < MAX_OCEAN_STEPS && t <= tEnd; i++) {
+        seaSteps++;
+        float cellSize = float(1 << level);
+        vec2 f = (origin.xz + direction.xz * t) * toGrid - 0.5;
+        ivec2 cell = ivec2(floor(f / cellSize));
+
+        // where the ray leaves this node
+        vec2 boundary = (vec2(cell) + step(0.0, df)) * cellSize;
+        vec2 tBoundary = vec2(1e10);
+        if (df.x != 0.0) tBoundary.x = t + (boundary.x - f.x) / df.x;
+        if (df.y != 0.0) tBoundary.y = t + (boundary.y - f.y) / df.y;
+        float tExit = min(min(tBoundary.x, tBoundary.y), tEnd);
+
+        int levelSize = textureSize(oceanHeightBounds, level).x;
+        vec2 bounds = texelFetch(oceanHeightBounds, cell & (levelSize - 1), level).rg * oceanHeightScale + sea_level;
+        float y0 = origin.y + direction.y * t;
+        float y1 = origin.y + direction.y * tExit;
+        if (min(y0, y1) <= bounds.y && max(y0, y1) >= bounds.x) {
+            if (level > 0) {
+                level--;
+                continue;
+            }
+            float hit = intersectOceanCell(cell, origin, direction, toGrid, t, tExit);
+            if (hit >= 0.0) {
+                return hit;
+            }
+        }
+
+        t = tExit + 1e-4;
+        // back up to the lowest ancestor the step stayed inside, a step across the corner
+        // of a large node leaves several levels at once
+        vec2 next = (origin.xz + direction.xz * t) * toGrid - 0.5;
+        ivec2 parent = cell >> 1;
+        while (level < top && ivec2(floor(next / float(2 << level))) != parent) {
+            level++;
+            parent >>= 1;
+        }
+    }
+    // out of steps before the end of the ray, take the surface to be where the march stopped
+    // rather than leave a hole in it
+    return t <= tEnd ? t : -1.0;
 }
 
-vec4 renderDynamicSea(vec3 cameraPosition, vec3 worldPosition, float depth)
+// Shades the sea at distance tSea along the view ray, tSea < 0 means the ray missed the sea
+vec4 renderDynamicSea(vec3 cameraPosition, vec3 viewDirection, float tSea)
 {
-    vec3 viewDirection = normalize(worldPosition - cameraPosition);
-    vec3 boxMin = vec3(-sea_width, sea_bottom, -sea_width);
-    vec3 boxMax = vec3(sea_width, sea_top, sea_width);
-    float tnear = intersectionAABB(boxMin, boxMax, cameraPosition, viewDirection).x;
-    if (abs(tnear - -1.0f) < 1e-8f || (depth > 0.0f && tnear > depth)) {
+    if (tSea < 0.0) {
         return vec4(0.0f);
     }
-    vec3 point = cameraPosition + viewDirection * max(tnear, 0.0);
-
-    vec2 pos = vec2(point.x, point.z);
-    float time = float(frameCounter)*0.05; // dynamic time
-
-    float H;
-    vec3 normal;
-    computeNormalFromHeight(pos, time, H, normal);
+    vec3 point = cameraPosition + viewDirection * tSea;
+    vec3 normal = normalize(texture(oceanNormal, point.xz / oceanPatchSize).xyz);
 
     float diffuse;
 
@@ -323,6 +434,7 @@ vec4 renderDynamicSea(vec3 cameraPosition, vec3 worldPosition, float depth)
 
 void main()
 {
+    vec3 rayDirection = normalize(rayVector);
     vec4 color = vec4(0.0f);
     mat4 mat = mat4(1.0f);
     mat[3] = vec4(meshTrans, 1.0f);
@@ -332,16 +444,15 @@ void main()
     // vec2 ret = intersectionKDTree(rayOrigin, rayDirection);
     int idx = int(round(ret.x));
     float t = ret.y;
-    vec4 dynamicSeaColor = renderDynamicSea(rayOrigin,  rayOrigin + rayDirection * 1000, t);
+    // the mesh hit, if any, bounds the sea march
+    float tSea = intersectOcean(rayOrigin, rayDirection, idx < 0 ? -1.0 : t);
+    vec4 dynamicSeaColor = renderDynamicSea(rayOrigin, rayDirection, tSea);
     if (idx < 0) {  // no intersection with mesh
         outColor = mix(vec4(0.529f, 0.808f, 0.922f, 1.0f), dynamicSeaColor, dynamicSeaColor.a);
         outDistance = -1.0f;
     }
     else {
-        vec3 boxMin = vec3(-sea_width, sea_bottom, -sea_width);
-        vec3 boxMax = vec3(sea_width, sea_top, sea_width);
-        float tnear = intersectionAABB(boxMin, boxMax, rayOrigin, rayDirection).x;
-        if (t < tnear) {
+        if (tSea < 0.0) {
             mesh m = getMesh(idx);
             vec3 worldPosition = rayOrigin + t * rayDirection;
             color = vec4(m.diffuseColor * max(dot(normalize(lightPos - worldPosition), m.faceNormal), 0.0f), 1.0f);
@@ -350,9 +461,10 @@ void main()
         }
         else {  // mesh is under water
             outColor = dynamicSeaColor;
-            outDistance = tnear;
+            outDistance = tSea;
         }
     }
+    outCost = vec4(nodesVisited, trianglesTested, seaSteps, 0.0);
     // else {   // only intersection
     //     return vec4(1.0f);
     // }
@@ -4,27 +4,37 @@
 const float PI = 3.14159265359;
 
 // Uniform
-uniform vec3 eyePosition;
-uniform vec3 lookVec;
-uniform vec3 upVec;
-uniform float viewAngle;
-uniform float nearPlane;
-uniform float screenWidth;
-uniform float screenHeight;
-uniform vec3 lightPos;
-
-// index
-in vec2 pixelIndex; // [0, screenWidth-1] and [0, screenHeight-1]
+// camera, shared by every pass through the CameraBlock uniform buffer
+layout(std140) uniform CameraBlock {
+	vec3 eyePosition;
+	float viewAngle;
+	vec3 lookVec;
+	float nearPlane;
+	vec3 upVec;
+	float screenWidth;
+	float screenHeight;
+	vec2 pixelJitter;   // sub-pixel ray offset of progressive refinement
+};
+layout(std140) uniform LightBlock {
+	vec3 lightPos;  // light position in world space
+};
+
+// one triangle covering the screen, corners from gl_VertexID, no vertex buffer
+const vec2 corners[3] = vec2[](vec2(-1.0, -1.0), vec2(3.0, -1.0), vec2(-1.0, 3.0));
 
 // outputs
 out vec3 rayOrigin;     // ray origin (eye position)
-out vec3 rayDirection;  // ray dir
+out vec3 rayVector;     // ray dir, not normalized so it interpolates exactly over the triangle
 out vec3 pixelColor;
 
 void main() {
+	// every output is linear in the pixel index, so the value interpolated at a pixel center
+	// is the one computed for that pixel, [0, screenWidth-1] and [0, screenHeight-1]
+	vec2 corner = corners[gl_VertexID];
+	vec2 pixelIndex = (corner * 0.5 + 0.5) * vec2(screenWidth, screenHeight) - 0.5 + pixelJitter;
 	float ndcX = (pixelIndex.x / screenWidth) * 2.0 - 1.0;
     float ndcY = (pixelIndex.y / screenHeight) * 2.0 - 1.0;
-	gl_Position = vec4(ndcX, ndcY, 0.0, 1.0); // screen location
+	gl_Position = vec4(corner, 0.0, 1.0); // screen location
 	float r = (ndcX + 1.0) / 2.0;
 	float g = (ndcY + 1.0) / 2.0;
 	pixelColor = vec3(r, g, 1.0f);
@@ -41,7 +51,7 @@ void main() {
 	vec3 v = upVec;
 	vec3 S = Q + a * u + b * v;
 	rayOrigin = eyePosition;
-	rayDirection = normalize(S - eyePosition);
+	rayVector = S - eyePosition;
 }
 
 // cpp version
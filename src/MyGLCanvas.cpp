@@ -1,7 +1,98 @@
 #include "MyGLCanvas.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include "shaders/ocean.h"
+#include "shaders/noise.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+
+// texture units of the ocean maps, above the mesh and kd-tree buffers
+const int OCEAN_HEIGHT_UNIT = 13;
+const int OCEAN_BOUNDS_UNIT = 14;
+const int OCEAN_NORMAL_UNIT = 15;
+
+// texture units of the cost view maps in the environment pass
+const int COST_MAP_UNIT = 10;
+const int CLOUD_STEPS_UNIT = 11;
+
+// frames between two readbacks of the cost counters
+const int COST_STATS_INTERVAL = 60;
+
+// std140 mirrors of the uniform blocks declared by the shaders
+struct CameraBlock {
+	glm::vec3 eyePosition;
+	float viewAngle;
+	glm::vec3 lookVec;
+	float nearPlane;
+	glm::vec3 upVec;
+	float screenWidth;
+	float screenHeight;
+	float padding;
+	glm::vec2 pixelJitter;
+};
+struct LightBlock {
+	glm::vec3 lightPos;
+	float padding;
+};
+struct CloudBlock {
+	float width;
+	float bottom;
+	float top;
+	float cloudSpeed;
+	float sampleRange;
+	float cloudDensity;
+	float stepSize;
+	GLint cloudScale;
+};
+static_assert(sizeof(CameraBlock) == 64 && sizeof(LightBlock) == 16 && sizeof(CloudBlock) == 32, "uniform blocks must match the std140 layout");
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint LIGHT_BLOCK_BINDING = 1;
+const GLuint CLOUD_BLOCK_BINDING = 2;
+
+// formats of the color and distance targets the object pass hands to the environment pass,
+// for each render quality from low to high
+struct TargetFormats {
+	GLenum color;
+	GLenum distance;
+	int bytesPerPixel;
+	const char* name;
+};
+const TargetFormats RENDER_QUALITY_TARGETS[] = {
+	{ GL_RGB10_A2, GL_R16F, 6, "RGB10_A2 / R16F" },		// sea highlights above 1 are clamped
+	{ GL_RGBA16F, GL_R16F, 10, "RGBA16F / R16F" },
+	{ GL_RGBA32F, GL_R32F, 20, "RGBA32F / R32F" },
+};
+const int RENDER_QUALITY_COUNT = sizeof(RENDER_QUALITY_TARGETS) / sizeof(RENDER_QUALITY_TARGETS[0]);
+
+// dynamic resolution: smallest render scale, scale step, and frames between two adjustments
+const float MIN_RENDER_SCALE = 0.5f;
+const float RENDER_SCALE_STEP = 0.05f;
+const int RENDER_SCALE_INTERVAL = 30;
+
+// stages of the GPU profile, in drawing order. The sea is traced by the object shader,
+// so it is part of the scene stage; the FFT ocean upload is in the upload stage.
+enum ProfileStage { PROFILE_UPLOAD, PROFILE_SCENE, PROFILE_CLOUD_MARCH, PROFILE_CLOUD_RESOLVE, PROFILE_ENVIRONMENT };
+const std::vector<std::string> PROFILE_STAGE_NAMES = { "upload", "scene", "cloud march", "cloud resolve", "environment" };
+
+// Halton sequence element: radical inverse of index in the given base, in [0, 1)
+static float halton(int index, int base) {
+	float result = 0.0f;
+	float fraction = 1.0f / base;
+	for (; index > 0; index /= base) {
+		result += fraction * (index % base);
+		fraction /= base;
+	}
+	return result;
+}
+
+// FNV-1a over the bytes of a value
+template <typename T>
+static void hashValue(uint64_t& hash, const T& value) {
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+	for (size_t i = 0; i < sizeof(T); i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+}
 
 MyGLCanvas::MyGLCanvas(int x, int y, int w, int h, const char* l) : Fl_Gl_Window(x, y, w, h, l) {
 	mode(FL_OPENGL3 | FL_RGB | FL_ALPHA | FL_DEPTH | FL_DOUBLE);
@@ -30,15 +121,61 @@ MyGLCanvas::MyGLCanvas(int x, int y, int w, int h, const char* l) : Fl_Gl_Window
 	segmentsY = 3;
 
 	firstTime = true;
+	vao = 0;
+	outputFBO = 0;
+	myObjectPLY = NULL;
+	meshTranslate = glm::vec3(0.0f);
+
+	// half float targets between the object and environment passes
+	renderQuality = 1;
+	renderQualityDirty = false;
+
+	// the cost counters are only kept while the cost view is on
+	costView = 0;
+	costTexID = 0;
+	costWidth = 0;
+	costHeight = 0;
+	for (float& scale : costScale) {
+		scale = 64.0f;
+	}
+
+	// render at the window resolution until the frame budget is exceeded
+	dynamicResolution = 0;
+	frameBudget = 16.6f;
+	renderScale = 1.0f;
+	gpuFrameTime = 0.0f;
+	renderWidth = 0;
+	renderHeight = 0;
+	framesSinceScaleChange = 0;
+	profiler = NULL;
+	resourcesReady = false;
+
+	// the ocean and the clouds move, every frame is rendered until progressive refinement is turned on
+	animate = 1;
+	progressive = 0;
+	progressiveSamples = 64;
+	accumulatedSamples = 0;
+	accumFBO = 0;
+	accumTexID = 0;
+	accumWidth = 0;
+	accumHeight = 0;
+	pixelJitter = glm::vec2(0.0f);
+	lastSceneHash = 0;
+	framesSinceChange = 0;
+	sceneVersion = 0;
+	prevAnimationFrame = 0;
 
 	myTextureManager = new TextureManager();
 	myShaderManager = new ShaderManager();
+	objectProgram = NULL;
+	environmentProgram = NULL;
+	cloudProgram = NULL;
+	cloudResolveProgram = NULL;
+	cameraBuffer = NULL;
+	lightBuffer = NULL;
+	cloudBuffer = NULL;
 	// myObjectPLY = new ply("./data/sphere.ply");
 
-	// initialize worley points
-	numCellsPerAxis = 10;
-	worleyPoints = CreateWorleyPoints(numCellsPerAxis);
-
 	// noiseTex = nullptr;
 	// initialize cloud data
 	cloudDensity = 1.0f;
@@ -47,48 +184,274 @@ MyGLCanvas::MyGLCanvas(int x, int y, int w, int h, const char* l) : Fl_Gl_Window
 	cloudBottom = 1.0f;
 	cloudTop = 5.0f;
 	sampleRange = 50.0f;
+	cloudStepSize = 0.1f;
+
+	// clouds are marched at half resolution
+	cloudScale = 2;
+	cloudTargetDirty = false;
+
+	// a quarter of the cloud pixels are marched each frame
+	cloudMarchStride = 2;
+	cloudHistoryIndex = 0;
+	cloudHistoryValid = false;
+
+	// the empty space grid is built once the noise exists
+	cloudSkipEmpty = 1;
+	cloudGridTexID = 0;
+	cloudGridCells = 16;
+	cloudGridDirty = true;
+
+	// default light
+	lightPos = glm::vec3(300.0f);
+
+	// clouds are lit from the scene light
+	cloudLightAbsorption = 2.0f;
+	cloudLightTexID = 0;
+	cloudLightValid = false;
+	cloudLightNoiseDirty = true;
+	cloudLightReady = false;
+
+	// initialize cloud noise generator
+	noiseResolution = 128;
+	noiseOctaves = 4;
+	noiseTextureSize = 128;
+
+	// the ocean is built on the first frame
+	oceanParams.N = 64;
+	oceanHeightScale = 0.25f;
+	ocean = NULL;
+	oceanDirty = true;
+	oceanHeightTexID = 0;
+	oceanBoundsTexID = 0;
+	oceanNormalTexID = 0;
 }
 
 MyGLCanvas::~MyGLCanvas() {
+	if (cloudLightThread.joinable()) {
+		cloudLightThread.join();
+	}
 	delete myTextureManager;
 	delete myShaderManager;
+	delete cameraBuffer;
+	delete lightBuffer;
+	delete cloudBuffer;
+	delete profiler;
 	delete myObjectPLY;
+	delete ocean;
 	// delete noiseTex;
 }
 
 void MyGLCanvas::initShaders() {
 	printf("init shaders\n");
-	myTextureManager->loadTexture3D("noiseTex", "./data/ppm/tiled_worley_noise.ppm");
+	noiseTextureSize = myTextureManager->loadTexture3D("noiseTex", "./data/ppm/tiled_worley_noise.ppm");
+	cloudGridDirty = true;
+	cloudLightNoiseDirty = true;
+	if (myTextureManager->getTextureID("noiseTex") == (unsigned int)-1) {
+		// no tiled noise file on disk, build the volume in process instead
+		generateNoise();
+	}
 	myTextureManager->loadTexture("seaTex", "./data/ppm/sea1.ppm");
 	myTextureManager->loadTexture("seaNormalTex", "./data/ppm/sea1_normal.ppm");
 	myShaderManager->addShaderProgram("objectShaders", "shaders/330/object-vert.shader", "shaders/330/object-frag.shader");
 	myShaderManager->addShaderProgram("environmentShaders", "shaders/330/environment-vert.shader", "shaders/330/environment-frag.shader");
+	myShaderManager->addShaderProgram("cloudShaders", "shaders/330/cloud-vert.shader", "shaders/330/cloud-frag.shader");
+	myShaderManager->addShaderProgram("cloudResolveShaders", "shaders/330/cloud-resolve-vert.shader", "shaders/330/cloud-resolve-frag.shader");
+
+	cameraBuffer = new UniformBuffer(CAMERA_BLOCK_BINDING, sizeof(CameraBlock));
+	lightBuffer = new UniformBuffer(LIGHT_BLOCK_BINDING, sizeof(LightBlock));
+	cloudBuffer = new UniformBuffer(CLOUD_BLOCK_BINDING, sizeof(CloudBlock));
+	resolveUniforms();
 }
 
-void MyGLCanvas::draw() {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// Looks up the programs and the handles of every uniform the canvas sets, after each (re)link
+void MyGLCanvas::resolveUniforms() {
+	objectProgram = myShaderManager->getShaderProgram("objectShaders");
+	environmentProgram = myShaderManager->getShaderProgram("environmentShaders");
+	cloudProgram = myShaderManager->getShaderProgram("cloudShaders");
+	cloudResolveProgram = myShaderManager->getShaderProgram("cloudResolveShaders");
+
+	auto resolveMarch = [](ShaderProgram* program, MarchUniforms& u) {
+		u.marchSize = program->getUniform("marchSize");
+		u.marchStride = program->getUniform("marchStride");
+		u.marchOffset = program->getUniform("marchOffset");
+	};
+	// elements of a sampler array, as many as the shader keeps active
+	auto resolveArray = [](ShaderProgram* program, const std::string& name, std::vector<Uniform>& u) {
+		u.clear();
+		for (Uniform element = program->getUniform(name + "[0]"); element.valid();
+			element = program->getUniform(name + "[" + std::to_string(u.size()) + "]")) {
+			u.push_back(element);
+		}
+	};
+
+	ObjectUniforms& o = objectUniforms;
+	o.meshTrans = objectProgram->getUniform("meshTrans");
+	o.frameCounter = objectProgram->getUniform("frameCounter");
+	o.oceanHeight = objectProgram->getUniform("oceanHeight");
+	o.oceanHeightBounds = objectProgram->getUniform("oceanHeightBounds");
+	o.oceanNormal = objectProgram->getUniform("oceanNormal");
+	o.oceanPatchSize = objectProgram->getUniform("oceanPatchSize");
+	o.oceanLevels = objectProgram->getUniform("oceanLevels");
+	o.oceanHeightScale = objectProgram->getUniform("oceanHeightScale");
+	resolveArray(objectProgram, "meshBuffer", o.meshBuffer);
+	resolveArray(objectProgram, "treeBuffer", o.treeBuffer);
+	o.numMeshBuffers = objectProgram->getUniform("numMeshBuffers");
+	o.maxTrianglesPerBuffer = objectProgram->getUniform("maxTrianglesPerBuffer");
+	o.meshSize = objectProgram->getUniform("meshSize");
+	o.numTreeBuffers = objectProgram->getUniform("numTreeBuffers");
+	o.maxNodesPerBuffer = objectProgram->getUniform("maxNodesPerBuffer");
+	o.rootIndex = objectProgram->getUniform("rootIndex");
+	o.treeSize = objectProgram->getUniform("treeSize");
+
+	EnvironmentUniforms& e = environmentUniforms;
+	e.colorMap = environmentProgram->getUniform("colorMap");
+	e.distanceMap = environmentProgram->getUniform("distanceMap");
+	e.cloudMap = environmentProgram->getUniform("cloudMap");
+	e.cloudDepthMap = environmentProgram->getUniform("cloudDepthMap");
+	e.seaTex = environmentProgram->getUniform("seaTex");
+	e.seaNormalTex = environmentProgram->getUniform("seaNormalTex");
+	e.framebufferSize = environmentProgram->getUniform("framebufferSize");
+	e.frameCounter = environmentProgram->getUniform("frameCounter");
+	e.costMap = environmentProgram->getUniform("costMap");
+	e.cloudStepsMap = environmentProgram->getUniform("cloudStepsMap");
+	e.costView = environmentProgram->getUniform("costView");
+	e.costScale = environmentProgram->getUniform("costScale");
+
+	CloudUniforms& c = cloudUniforms;
+	resolveMarch(cloudProgram, c.march);
+	c.noiseTex = cloudProgram->getUniform("noiseTex");
+	c.distanceMap = cloudProgram->getUniform("distanceMap");
+	c.cloudGrid = cloudProgram->getUniform("cloudGrid");
+	c.cloudGridCells = cloudProgram->getUniform("cloudGridCells");
+	c.skipEmpty = cloudProgram->getUniform("skipEmpty");
+	c.cloudLight = cloudProgram->getUniform("cloudLight");
+	c.cloudLightShift = cloudProgram->getUniform("cloudLightShift");
+	c.cloudLightValid = cloudProgram->getUniform("cloudLightValid");
+	c.blueNoise = cloudProgram->getUniform("blueNoise");
+	c.frameCounter = cloudProgram->getUniform("frameCounter");
+	c.animationFrame = cloudProgram->getUniform("animationFrame");
+
+	CloudResolveUniforms& r = cloudResolveUniforms;
+	resolveMarch(cloudResolveProgram, r.march);
+	r.marchMap = cloudResolveProgram->getUniform("marchMap");
+	r.distanceMap = cloudResolveProgram->getUniform("distanceMap");
+	r.historyMap = cloudResolveProgram->getUniform("historyMap");
+	r.historyDepthMap = cloudResolveProgram->getUniform("historyDepthMap");
+	r.historyValid = cloudResolveProgram->getUniform("historyValid");
+	r.prevEyePosition = cloudResolveProgram->getUniform("prevEyePosition");
+	r.prevLookVec = cloudResolveProgram->getUniform("prevLookVec");
+	r.prevUpVec = cloudResolveProgram->getUniform("prevUpVec");
+	r.cloudSize = cloudResolveProgram->getUniform("cloudSize");
+	r.driftFrames = cloudResolveProgram->getUniform("driftFrames");
+
+	bindUniformBlocks();
+}
 
-	if (!valid()) {  //this is called when the GL canvas is set up for the first time or when it is resized...
-		printf("establishing GL context\n");
+// block bindings are program state, so they are set again whenever the programs are relinked
+void MyGLCanvas::bindUniformBlocks() {
+	ShaderProgram* programs[] = { objectProgram, environmentProgram, cloudProgram, cloudResolveProgram };
+	for (ShaderProgram* program : programs) {
+		cameraBuffer->bindProgram(program->programID, "CameraBlock");
+		lightBuffer->bindProgram(program->programID, "LightBlock");
+		cloudBuffer->bindProgram(program->programID, "CloudBlock");
+	}
+}
 
-		glViewport(0, 0, w(), h());
-		updateCamera(w(), h());
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+// Fills the shared uniform blocks for this frame, UniformBuffer skips the ones that did not change
+void MyGLCanvas::uploadUniformBlocks() {
+	CameraBlock cameraBlock = {};
+	cameraBlock.eyePosition = camera->getEyePoint();
+	cameraBlock.viewAngle = camera->getViewAngle();
+	cameraBlock.lookVec = camera->getLookVector();
+	cameraBlock.nearPlane = camera->getNearPlane();
+	cameraBlock.upVec = camera->getUpVector();
+	// rays are generated for the render resolution, the environment pass upscales to the window
+	cameraBlock.screenWidth = (float)renderWidth;
+	cameraBlock.screenHeight = (float)renderHeight;
+	cameraBlock.pixelJitter = pixelJitter;
+	cameraBuffer->update(&cameraBlock, sizeof(CameraBlock));
+
+	LightBlock lightBlock = {};
+	lightBlock.lightPos = lightPos;
+	lightBuffer->update(&lightBlock, sizeof(LightBlock));
+
+	CloudBlock cloudBlock = {};
+	cloudBlock.width = cloudWidth;
+	cloudBlock.bottom = cloudBottom;
+	cloudBlock.top = cloudTop;
+	cloudBlock.cloudSpeed = cloudSpeed;
+	cloudBlock.sampleRange = sampleRange;
+	cloudBlock.cloudDensity = cloudDensity;
+	cloudBlock.stepSize = cloudStepSize;
+	cloudBlock.cloudScale = cloudScale;
+	cloudBuffer->update(&cloudBlock, sizeof(CloudBlock));
+}
 
-		/****************************************/
-		/*          Enable z-buferring          */
-		/****************************************/
+void MyGLCanvas::setOceanParams(const OceanParams& params) {
+	oceanParams = params;
+	oceanDirty = true;
+	sceneVersion++;
+}
 
-		glEnable(GL_DEPTH_TEST);
-		glPolygonOffset(1, 1);
-		if (firstTime == true) {
-			firstTime = false;
-			initShaders();
-			initializeVertexBuffer();
-			initializeFBO(w(), h());
+// Evolves the FFT ocean to the current frame and uploads its height, min / max pyramid and normals,
+// so the sea shader cost depends on the grid size and not on how many waves the spectrum has
+void MyGLCanvas::updateOcean() {
+	if (oceanDirty) {
+		delete ocean;
+		ocean = new Ocean(oceanParams);
+		int size = ocean->getSize();
+		GLuint* textures[] = { &oceanHeightTexID, &oceanBoundsTexID, &oceanNormalTexID };
+		for (GLuint* tex : textures) {
+			if (*tex == 0) {
+				glGenTextures(1, tex);
+			}
+			glBindTexture(GL_TEXTURE_2D, *tex);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		}
+		// heights and bounds are read with texelFetch
+		glBindTexture(GL_TEXTURE_2D, oceanHeightTexID);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glBindTexture(GL_TEXTURE_2D, oceanBoundsTexID);
+		for (int level = 0; level < ocean->getLevelCount(); level++) {
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RG32F, size >> level, size >> level, 0, GL_RG, GL_FLOAT, nullptr);
 		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, ocean->getLevelCount() - 1);
+		glBindTexture(GL_TEXTURE_2D, oceanNormalTexID);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, size, size, 0, GL_RGB, GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		oceanDirty = false;
 	}
 
+	ocean->update(float(animationFrame) * 0.05f);	// same time step the shader used
+	int size = ocean->getSize();
+	glBindTexture(GL_TEXTURE_2D, oceanHeightTexID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RED, GL_FLOAT, ocean->getHeights().data());
+	glBindTexture(GL_TEXTURE_2D, oceanBoundsTexID);
+	for (int level = 0; level < ocean->getLevelCount(); level++) {
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, size >> level, size >> level, GL_RG, GL_FLOAT, ocean->getHeightBounds(level).data());
+	}
+	glBindTexture(GL_TEXTURE_2D, oceanNormalTexID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGB, GL_FLOAT, ocean->getNormals().data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void MyGLCanvas::draw() {
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	if (!valid()) {  //this is called when the GL canvas is set up for the first time or when it is resized...
+		printf("establishing GL context\n");
+		setupContext();
+	}
+	initializeResources();
+
 	// Clear the buffer of colors in each bit plane.
 	// bit plane - A set of bits that are on or off (Think of a black and white image)
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -96,43 +459,69 @@ void MyGLCanvas::draw() {
 	drawScene();
 }
 
-// Generate Worley points buffer
-std::vector<glm::vec3> MyGLCanvas::CreateWorleyPoints(int numCellsPerAxis) {
-    std::vector<glm::vec3> points;
-    float cellSize = 1.0f / numCellsPerAxis;
-
-    for (int x = 0; x < numCellsPerAxis; x++) {
-        for (int y = 0; y < numCellsPerAxis; y++) {
-            for (int z = 0; z < numCellsPerAxis; z++) {
-                glm::vec3 randomOffset = glm::vec3(
-                    static_cast<float>(rand()) / RAND_MAX,
-                    static_cast<float>(rand()) / RAND_MAX,
-                    static_cast<float>(rand()) / RAND_MAX
-                );
-                glm::vec3 position = glm::vec3(x, y, z) + randomOffset * cellSize;
-                points.push_back(position);
-            }
-        }
-    }
-    return points;
+// Viewport, camera and GL state for the current size, programs are created the first time
+void MyGLCanvas::setupContext() {
+	glViewport(0, 0, w(), h());
+	updateCamera(w(), h());
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+
+	/****************************************/
+	/*          Enable z-buferring          */
+	/****************************************/
+
+	glEnable(GL_DEPTH_TEST);
+	glPolygonOffset(1, 1);
+	if (firstTime == true) {
+		firstTime = false;
+		initShaders();
+	}
+}
+
+// Vertex array, render targets and pass timers, created once a context is current. Not tied
+// to firstTime: handle() clears that on FL_SHOW to load GLEW, before the first draw.
+void MyGLCanvas::initializeResources() {
+	if (profiler == NULL) {
+		profiler = new GpuProfiler(PROFILE_STAGE_NAMES);
+	}
+	if (resourcesReady) {
+		return;
+	}
+	initializeVertexBuffer();
+	initializeFBO(w(), h());
+	renderWidth = w();
+	renderHeight = h();
+	initializeCloudFBO();
+	resourcesReady = true;
+}
+
+// Same frame as draw, into a framebuffer of the caller instead of the window. Needs no FLTK
+// event loop: the caller makes a GL context current (and loads GLEW) and keeps the size fixed.
+void MyGLCanvas::drawOffscreen(GLuint framebuffer) {
+	outputFBO = framebuffer;
+	if (firstTime) {
+		setupContext();
+	}
+	initializeResources();
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	drawScene();
 }
 
-// Update worley points
-void MyGLCanvas::updateWorleyPoints(int numCellsPerAxis) {
-	worleyPoints = CreateWorleyPoints(numCellsPerAxis);
-	// pass worley points
-	GLuint worleyTBO, worleyTexture;
-	glGenBuffers(2, &worleyTBO);
-	glBindBuffer(GL_TEXTURE_BUFFER, worleyTBO);
-	glBufferData(GL_TEXTURE_BUFFER, worleyPoints.size() * sizeof(glm::vec3), worleyPoints.data(), GL_STATIC_DRAW);
-	glGenTextures(2, &worleyTexture);
-	glBindTexture(GL_TEXTURE_BUFFER, worleyTexture);
-	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, worleyTBO);
-	// GLint worleyPointsLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "worleyPoints");
-	// glUniform1i(worleyPointsLoc, 0);
+// Waits for the cloud light volume being built, so the next frame uploads it however long the build
+// takes and offscreen frames do not depend on the timing of the worker thread
+void MyGLCanvas::finishCloudLight() {
+	while (cloudLightThread.joinable() && !cloudLightReady) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
 }
 
 void MyGLCanvas::drawScene() {
+	// a converged image is shown again as it is until something changes
+	if (isConverged() && !sceneChanged()) {
+		presentAccumulation();
+		return;
+	}
+
 	// incr frame counter
 	frameCounter++;
 	if (frameCounter == INT_MAX)
@@ -140,76 +529,64 @@ void MyGLCanvas::drawScene() {
 		frameCounter = 0;
 	}
 
-	// make object shaders output into fbo
+	// pick the render resolution from the GPU time of the last frames, then time this one
+	updateRenderScale();
+	updateProgressive();
+	profiler->beginFrame();
+
+	// finish pending texture uploads, the clouds switch to a volume once it is complete
+	profiler->begin(PROFILE_UPLOAD);
+	if (myTextureManager->updateTextures()) {
+		updateNoise();
+	}
+
+	// ocean heightfield for this frame
+	updateOcean();
+
+	// camera, light and cloud parameters shared by every pass
+	uploadUniformBlocks();
+
+	// color and distance targets in the formats of the render quality
+	if (renderQualityDirty) {
+		resizeFBO(renderWidth, renderHeight);
+		renderQualityDirty = false;
+	}
+
+	// traversal counters for the cost view
+	if (costView) {
+		updateCostTarget();
+	}
+
+	// make object shaders output into fbo, at the render resolution
+	profiler->begin(PROFILE_SCENE);
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, renderWidth, renderHeight);
+	GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(costView ? 3 : 2, drawBuffers);
 
-    glUseProgram(myShaderManager->getShaderProgram("objectShaders")->programID);
+    objectProgram->use();
 
     // bind vao
     glBindVertexArray(vao);
 
-    // pass Uniform
-    GLint eyeLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "eyePosition");
-    GLint lookVecLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "lookVec");
-    GLint upVecLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "upVec");
-    GLint viewAngleLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "viewAngle");
-    GLint nearLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "nearPlane");
-    GLint widthLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "screenWidth");
-    GLint heightLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "screenHeight");
-    GLint lightPosLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "lightPos");
-    GLint meshTransLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "meshTrans");
-
-	// pass camera data
-	glUniform3fv(eyeLoc, 1, glm::value_ptr(camera->getEyePoint()));
-	glUniform3fv(lookVecLoc, 1, glm::value_ptr(camera->getLookVector()));
-	glUniform3fv(upVecLoc, 1, glm::value_ptr(camera->getUpVector()));
-	glUniform1f(viewAngleLoc, camera->getViewAngle());
-	glUniform1f(nearLoc, camera->getNearPlane());
-	glUniform1f(widthLoc, camera->getScreenWidth());
-	glUniform1f(heightLoc, camera->getScreenHeight());
-	glUniform3fv(lightPosLoc, 1, glm::value_ptr(glm::vec3(300.0f)));	// default light
-	glUniform3fv(meshTransLoc, 1, glm::value_ptr(meshTranslate));	// mesh translation
-
-	glUniform1i(glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "frameCounter"), frameCounter);
-
-	// Pass wave data to object shaders
-	std::vector<WaveData> waves = generatePhillipsSpectrum();
-	int count = (int)waves.size();
-
-	std::vector<GLfloat> dirData;
-	dirData.reserve(count * 2);
-	std::vector<GLfloat> omegaData;
-	omegaData.reserve(count);
-	std::vector<GLfloat> ampData;
-	ampData.reserve(count);
-	std::vector<GLfloat> phaseData;
-	phaseData.reserve(count);
-
-	for (auto &w : waves) {
-		dirData.push_back(w.dirX);
-		dirData.push_back(w.dirZ);
-		omegaData.push_back(w.omega);
-		ampData.push_back(w.amplitude);
-		phaseData.push_back(w.phaseOffset);
-	}
-
-	GLuint progID = myShaderManager->getShaderProgram("objectShaders")->programID;
-
-	GLint waveCountLoc = glGetUniformLocation(progID, "waveCount");
-	glUniform1i(waveCountLoc, count);
-
-	GLint waveDirLoc = glGetUniformLocation(progID, "waveDir");
-	glUniform2fv(waveDirLoc, count, dirData.data());
-
-	GLint waveOmegaLoc = glGetUniformLocation(progID, "waveOmega");
-	glUniform1fv(waveOmegaLoc, count, omegaData.data());
-
-	GLint waveAmplitudeLoc = glGetUniformLocation(progID, "waveAmplitude");
-	glUniform1fv(waveAmplitudeLoc, count, ampData.data());
-
-	GLint wavePhaseOffsetLoc = glGetUniformLocation(progID, "wavePhaseOffset");
-	glUniform1fv(wavePhaseOffsetLoc, count, phaseData.data());
-
+	// pass mesh data
+	ObjectUniforms& o = objectUniforms;
+	objectProgram->set(o.meshTrans, meshTranslate);	// mesh translation
+	objectProgram->set(o.frameCounter, frameCounter);
+
+	// pass ocean maps
+	glActiveTexture(GL_TEXTURE0 + OCEAN_HEIGHT_UNIT);
+	glBindTexture(GL_TEXTURE_2D, oceanHeightTexID);
+	objectProgram->set(o.oceanHeight, OCEAN_HEIGHT_UNIT);
+	glActiveTexture(GL_TEXTURE0 + OCEAN_BOUNDS_UNIT);
+	glBindTexture(GL_TEXTURE_2D, oceanBoundsTexID);
+	objectProgram->set(o.oceanHeightBounds, OCEAN_BOUNDS_UNIT);
+	glActiveTexture(GL_TEXTURE0 + OCEAN_NORMAL_UNIT);
+	glBindTexture(GL_TEXTURE_2D, oceanNormalTexID);
+	objectProgram->set(o.oceanNormal, OCEAN_NORMAL_UNIT);
+	objectProgram->set(o.oceanPatchSize, ocean->getPatchSize());
+	objectProgram->set(o.oceanLevels, ocean->getLevelCount());
+	objectProgram->set(o.oceanHeightScale, oceanHeightScale);
 
 	// pass scene data
 	if (this->parser || this->myObjectPLY) {
@@ -217,55 +594,60 @@ void MyGLCanvas::drawScene() {
 		for (size_t i = 0; i < this->meshTextureBuffers.size(); ++i) {
 			glActiveTexture(GL_TEXTURE0 + i);
 			glBindTexture(GL_TEXTURE_BUFFER, this->meshTextureBuffers[i]);
-			std::string uniformName = "meshBuffer[" + std::to_string(i) + "]";
-			GLuint location = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, uniformName.c_str());
-			glUniform1i(location, i); // Bind texture to the corresponding uniform
+			if (i < o.meshBuffer.size()) {
+				objectProgram->set(o.meshBuffer[i], int(i)); // Bind texture to the corresponding uniform
+			}
 		}
-    	GLint numMeshBuffersLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "numMeshBuffers");
-    	GLint maxTrianglesPerBufferLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "maxTrianglesPerBuffer");
-		glUniform1i(numMeshBuffersLoc, this->meshTextureBuffers.size());
+		objectProgram->set(o.numMeshBuffers, int(this->meshTextureBuffers.size()));
 		size_t maxTrianglesPerBuffer = maxBufferSize / (floatsPerTriangle * sizeof(float));
-		glUniform1i(maxTrianglesPerBufferLoc, int(maxTrianglesPerBuffer));
-		GLint meshSizeLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "meshSize");
-		glUniform1i(meshSizeLoc, meshSize);
+		objectProgram->set(o.maxTrianglesPerBuffer, int(maxTrianglesPerBuffer));
+		objectProgram->set(o.meshSize, meshSize);
 
 		// pass kdtree array
 		size_t startTextureUnit = this->meshTextureBuffers.size(); // Offset by the number of mesh buffers
 		for (size_t i = 0; i < this->treeTextureBuffers.size(); ++i) {
 			glActiveTexture(GL_TEXTURE0 + startTextureUnit + i); // Start from the next available texture unit
 			glBindTexture(GL_TEXTURE_BUFFER, this->treeTextureBuffers[i]);
-			std::string uniformName = "treeBuffer[" + std::to_string(i) + "]";
-			GLuint location = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, uniformName.c_str());
-			glUniform1i(location, startTextureUnit + i); // Bind texture to the corresponding uniform
+			if (i < o.treeBuffer.size()) {
+				objectProgram->set(o.treeBuffer[i], int(startTextureUnit + i)); // Bind texture to the corresponding uniform
+			}
 		}
-		GLint numTreeBuffersLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "numTreeBuffers");
-    	GLint maxNodesPerBufferLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "maxNodesPerBuffer");
-    	GLint rootIndexLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "rootIndex");
-		glUniform1i(numTreeBuffersLoc, this->treeTextureBuffers.size());
+		objectProgram->set(o.numTreeBuffers, int(this->treeTextureBuffers.size()));
 		size_t maxNodesPerBuffer = maxBufferSize / (floatsPerNode * sizeof(float));
-		glUniform1i(maxNodesPerBufferLoc, int(maxNodesPerBuffer));
-		glUniform1i(rootIndexLoc, rootIndex);
-		GLint treeSizeLoc = glGetUniformLocation(myShaderManager->getShaderProgram("objectShaders")->programID, "treeSize");
-		glUniform1i(treeSizeLoc, treeSize);
+		objectProgram->set(o.maxNodesPerBuffer, int(maxNodesPerBuffer));
+		objectProgram->set(o.rootIndex, rootIndex);
+		objectProgram->set(o.treeSize, treeSize);
 
 		// pass light
 		// SceneLightData lightData;
 		// if (parser && parser->getLightData(0, lightData)) {
-		// 	glUniform3fv(lightPosLoc, 1, glm::value_ptr(lightData.pos));
+		// 	objectProgram->set(o.lightPos, lightData.pos);
 		// }
 	}
 
-    // draw pixels
-    glDrawArrays(GL_POINTS, 0, w() * h());
-
-	// readFBOData(w(), h());
+    // draw the full screen triangle
+    glDrawArrays(GL_TRIANGLES, 0, 3);
 
 	// release depth buffer and frame buffer
 	glClear(GL_DEPTH_BUFFER_BIT);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, w(), h());
+
+	// march a subset of the cloud pixels, then fill the cloud target from them and the previous frame
+	profiler->begin(PROFILE_CLOUD_MARCH);
+	drawClouds();
+	profiler->begin(PROFILE_CLOUD_RESOLVE);
+	resolveClouds();
 
-	// draw environment
-	glUseProgram(myShaderManager->getShaderProgram("environmentShaders")->programID);
+	if (costView && frameCounter % COST_STATS_INTERVAL == 0) {
+		readCostStats();
+	}
+
+	// draw environment into the window, or the target of drawOffscreen
+	profiler->begin(PROFILE_ENVIRONMENT);
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+	environmentProgram->use();
+	EnvironmentUniforms& e = environmentUniforms;
 
 	// bind vao
     glBindVertexArray(vao);
@@ -274,80 +656,235 @@ void MyGLCanvas::drawScene() {
     // glActiveTexture(GL_TEXTURE0);
     // noiseTex->bindTexture();
 
-    // // pass texture to shader
-    // GLuint programID = myShaderManager->getShaderProgram("environmentShaders")->programID;
-    // GLint textureUniformLoc = glGetUniformLocation(programID, "noiseTex");
-    // glUniform1i(textureUniformLoc, 0); // bing to GL_TEXTURE0
-
 	// use fbo
 	// bind color tex to GL_TEXTURE1
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, colorTexID);
-	GLint colorMapLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "colorMap");
-	glUniform1i(colorMapLoc, 1);
+	environmentProgram->set(e.colorMap, 1);
 
 	// bind distance tex to GL_TEXTURE2
 	glActiveTexture(GL_TEXTURE2);
 	glBindTexture(GL_TEXTURE_2D, distanceTexID);
-	GLint distanceMapLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "distanceMap");
-	glUniform1i(distanceMapLoc, 2);
+	environmentProgram->set(e.distanceMap, 2);
+
+	// bind cloud target to GL_TEXTURE5 and GL_TEXTURE6
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_2D, cloudTexIDs[cloudHistoryIndex]);
+	environmentProgram->set(e.cloudMap, 5);
+	glActiveTexture(GL_TEXTURE6);
+	glBindTexture(GL_TEXTURE_2D, cloudDepthTexIDs[cloudHistoryIndex]);
+	environmentProgram->set(e.cloudDepthMap, 6);
 
 	// bind sea tex to GL_TEXTURE3
-	GLint seaTexLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "seaTex");
     glActiveTexture(GL_TEXTURE3);
     glBindTexture(GL_TEXTURE_2D, myTextureManager->getTextureID("seaTex"));
-    glUniform1i(seaTexLoc, 3);
+	environmentProgram->set(e.seaTex, 3);
 
 	// bind sea tex to GL_TEXTURE4
-    GLint seaNormalTexLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "seaNormalTex");
     glActiveTexture(GL_TEXTURE4);
     glBindTexture(GL_TEXTURE_2D, myTextureManager->getTextureID("seaNormalTex"));
-    glUniform1i(seaNormalTexLoc, 4);
-
-    // pass Uniform
-    eyeLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "eyePosition");
-    lookVecLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "lookVec");
-    upVecLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "upVec");
-    viewAngleLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "viewAngle");
-    nearLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "nearPlane");
-    widthLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "screenWidth");
-    heightLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "screenHeight");
-    lightPosLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "lightPos");
-	GLint framebufferSizeLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "framebufferSize");
-	// pass camera data
-	glUniform3fv(eyeLoc, 1, glm::value_ptr(camera->getEyePoint()));
-	glUniform3fv(lookVecLoc, 1, glm::value_ptr(camera->getLookVector()));
-	glUniform3fv(upVecLoc, 1, glm::value_ptr(camera->getUpVector()));
-	glUniform1f(viewAngleLoc, camera->getViewAngle());
-	glUniform1f(nearLoc, camera->getNearPlane());
-	glUniform1f(widthLoc, camera->getScreenWidth());
-	glUniform1f(heightLoc, camera->getScreenHeight());
-	glUniform3fv(lightPosLoc, 1, glm::value_ptr(glm::vec3(300.0f)));	// default light
-	glUniform2f(framebufferSizeLoc, float(w()), float(h()));
-
-	glUniform1i(glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "frameCounter"), frameCounter);
-	// pass cloud data
-	GLint cloudDensityLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "cloudDensity");
-	GLint cloudSpeedLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "cloudSpeed");
-	GLint cloudWidthLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "width");
-	GLint cloudBottomLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "bottom");
-	GLint cloudTopLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "top");
-	GLint sampleRangeLoc = glGetUniformLocation(myShaderManager->getShaderProgram("environmentShaders")->programID, "sampleRange");
-
-	// pass cloud data
-	glUniform1f(cloudDensityLoc, cloudDensity);
-	glUniform1f(cloudSpeedLoc, cloudSpeed);
-	glUniform1f(cloudWidthLoc, cloudWidth);
-	glUniform1f(cloudBottomLoc, cloudBottom);
-	glUniform1f(cloudTopLoc, cloudTop);
-	glUniform1f(sampleRangeLoc, sampleRange);
-
-    glDrawArrays(GL_POINTS, 0, w() * h());
-	
+	environmentProgram->set(e.seaNormalTex, 4);
+
+	// pass framebuffer data
+	environmentProgram->set(e.framebufferSize, glm::vec2(renderWidth, renderHeight));
+	environmentProgram->set(e.frameCounter, frameCounter);
+
+	// pass the counters of the cost view on GL_TEXTURE10 and GL_TEXTURE11
+	environmentProgram->set(e.costView, costView);
+	if (costView) {
+		glActiveTexture(GL_TEXTURE0 + COST_MAP_UNIT);
+		glBindTexture(GL_TEXTURE_2D, costTexID);
+		environmentProgram->set(e.costMap, COST_MAP_UNIT);
+		glActiveTexture(GL_TEXTURE0 + CLOUD_STEPS_UNIT);
+		glBindTexture(GL_TEXTURE_2D, marchStepsTexID);
+		environmentProgram->set(e.cloudStepsMap, CLOUD_STEPS_UNIT);
+		environmentProgram->set(e.costScale, costScale[costView - 1]);
+	}
+
+	// progressive refinement blends sample n into the average of the previous ones with weight 1 / (n + 1)
+	if (progressive) {
+		resizeAccumulation();
+		glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+		glEnable(GL_BLEND);
+		glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / (accumulatedSamples + 1));
+		glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+	}
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+	if (progressive) {
+		glDisable(GL_BLEND);
+		glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+		accumulatedSamples++;
+		presentAccumulation();
+	}
 
     // release
     glBindVertexArray(0);
     glUseProgram(0);
+	profiler->endFrame();
+}
+
+// Frame time follows the pixel count, the square of the scale. The scale moves toward the budget
+// in RENDER_SCALE_STEP steps, at most once every RENDER_SCALE_INTERVAL frames and only when the
+// smoothed GPU time is clearly off, since every change reallocates the targets and drops the cloud history.
+void MyGLCanvas::updateRenderScale() {
+	double milliseconds;
+	if (profiler->poll(milliseconds)) {
+		gpuFrameTime = gpuFrameTime > 0.0f ? 0.9f * gpuFrameTime + 0.1f * (float)milliseconds : (float)milliseconds;
+	}
+	framesSinceScaleChange++;
+
+	float scale = renderScale;
+	if (!dynamicResolution) {
+		scale = 1.0f;
+	}
+	else if (accumulatedSamples > 0) {
+		// a resolution change would restart the refinement, and a still view has no frame rate to keep
+	}
+	else if (gpuFrameTime > 0.0f && framesSinceScaleChange >= RENDER_SCALE_INTERVAL) {
+		float ratio = frameBudget / gpuFrameTime;
+		if (ratio < 0.95f || ratio > 1.2f) {
+			// drop quickly when over budget, grow back slowly
+			float target = renderScale * std::sqrt(ratio);
+			target = std::max(renderScale * 0.75f, std::min(renderScale + RENDER_SCALE_STEP, target));
+			scale = std::round(target / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+			scale = std::max(MIN_RENDER_SCALE, std::min(1.0f, scale));
+		}
+	}
+	if (scale != renderScale) {
+		renderScale = scale;
+		// the smoothed time and the queries in flight belong to the old resolution
+		gpuFrameTime = 0.0f;
+		framesSinceScaleChange = 0;
+	}
+	updateRenderSize();
+}
+
+// Internal resolution of the object and cloud passes, the environment pass upscales it to the window
+void MyGLCanvas::updateRenderSize() {
+	int width = std::max(1, (int)(w() * renderScale + 0.5f));
+	int height = std::max(1, (int)(h() * renderScale + 0.5f));
+	if (width == renderWidth && height == renderHeight) {
+		return;
+	}
+	renderWidth = width;
+	renderHeight = height;
+	resizeFBO(renderWidth, renderHeight);
+	cloudTargetDirty = true;
+}
+
+// Everything a frame depends on besides the animation time. A different hash from one frame
+// to the next restarts progressive refinement.
+uint64_t MyGLCanvas::sceneHash() {
+	uint64_t hash = 14695981039346656037ull;
+	hashValue(hash, camera->getEyePoint());
+	hashValue(hash, camera->getLookVector());
+	hashValue(hash, camera->getUpVector());
+	hashValue(hash, camera->getViewAngle());
+	hashValue(hash, camera->getNearPlane());
+	hashValue(hash, w());
+	hashValue(hash, h());
+	hashValue(hash, renderWidth);
+	hashValue(hash, renderHeight);
+	hashValue(hash, renderQuality);
+	hashValue(hash, costView);
+	hashValue(hash, lightPos);
+	hashValue(hash, meshTranslate);
+	hashValue(hash, oceanHeightScale);
+	hashValue(hash, cloudDensity);
+	hashValue(hash, cloudSpeed);
+	hashValue(hash, cloudWidth);
+	hashValue(hash, cloudBottom);
+	hashValue(hash, cloudTop);
+	hashValue(hash, sampleRange);
+	hashValue(hash, cloudStepSize);
+	hashValue(hash, cloudScale);
+	hashValue(hash, cloudMarchStride);
+	hashValue(hash, cloudSkipEmpty);
+	hashValue(hash, cloudLightAbsorption);
+	hashValue(hash, sceneVersion);
+	return hash;
+}
+
+// Restarts the accumulation when the scene changed and picks the jitter of the next sample.
+// The animation only advances on the first sample, a still view is refined at a fixed time.
+void MyGLCanvas::updateProgressive() {
+	uint64_t hash = sceneHash();
+	if (!progressive || hash != lastSceneHash) {
+		accumulatedSamples = 0;
+	}
+	framesSinceChange = hash != lastSceneHash ? 0 : std::min(framesSinceChange + 1, INT_MAX - 1);
+	lastSceneHash = hash;
+
+	if (accumulatedSamples == 0) {
+		if (animate) {
+			animationFrame++;
+			if (animationFrame == INT_MAX) {
+				animationFrame = 0;
+			}
+		}
+		pixelJitter = glm::vec2(0.0f);
+	}
+	else {
+		// low discrepancy offsets within the pixel
+		pixelJitter = glm::vec2(halton(accumulatedSamples, 2), halton(accumulatedSamples, 3)) - 0.5f;
+	}
+}
+
+bool MyGLCanvas::isConverged() {
+	return progressive && accumulatedSamples >= progressiveSamples;
+}
+
+// also true when a light volume finished building in the background
+bool MyGLCanvas::sceneChanged() {
+	return sceneHash() != lastSceneHash || (cloudLightThread.joinable() && cloudLightReady);
+}
+
+// Whether the next frame would differ from the one on screen. After a change the cloud
+// march pattern needs cloudMarchStride^2 frames to visit every cloud pixel once.
+bool MyGLCanvas::needsRedraw() {
+	if (sceneChanged() || framesSinceChange < cloudMarchStride * cloudMarchStride) {
+		return true;
+	}
+	if (progressive) {
+		return !isConverged();
+	}
+	return animate != 0;
+}
+
+// Float target at the window size, so the average keeps the precision of many samples
+void MyGLCanvas::resizeAccumulation() {
+	if (accumFBO == 0) {
+		glGenFramebuffers(1, &accumFBO);
+		glGenTextures(1, &accumTexID);
+	}
+	if (accumWidth == w() && accumHeight == h()) {
+		return;
+	}
+	accumWidth = w();
+	accumHeight = h();
+	glBindTexture(GL_TEXTURE_2D, accumTexID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, accumWidth, accumHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexID, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Accumulation framebuffer not complete!\n");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Copies the accumulated average to the window
+void MyGLCanvas::presentAccumulation() {
+	if (accumFBO == 0) {
+		return;
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, accumFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFBO);
+	glBlitFramebuffer(0, 0, accumWidth, accumHeight, 0, 0, w(), h(), GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
 }
 
 
@@ -391,8 +928,7 @@ int MyGLCanvas::handle(int e) {
 
 void MyGLCanvas::resize(int x, int y, int w, int h) {
 	Fl_Gl_Window::resize(x, y, w, h);
-	initializeVertexBuffer();
-	resizeFBO(w, h);
+	// no context is current here, the next draw resizes the targets to the new window size
 	puts("resize called");
 }
 
@@ -401,6 +937,10 @@ void MyGLCanvas::reloadShaders() {
 
 	myShaderManager->addShaderProgram("objectShaders", "shaders/330/object-vert.shader", "shaders/330/object-frag.shader");
 	myShaderManager->addShaderProgram("environmentShaders", "shaders/330/environment-vert.shader", "shaders/330/environment-frag.shader");
+	myShaderManager->addShaderProgram("cloudShaders", "shaders/330/cloud-vert.shader", "shaders/330/cloud-frag.shader");
+	myShaderManager->addShaderProgram("cloudResolveShaders", "shaders/330/cloud-resolve-vert.shader", "shaders/330/cloud-resolve-frag.shader");
+	resolveUniforms();
+	sceneVersion++;
 	// myObjectPLY->bindVBO(myShaderManager->getShaderProgram("objectShaders")->programID);
 
 	invalidate();
@@ -413,6 +953,7 @@ void MyGLCanvas::loadSceneFile(const char* filenamePath) {
 		delete scene;
 	}
 	parser = new SceneParser(filenamePath);
+	sceneVersion++;
 
 	bool success = parser->parse();
 	cout << "success? " << success << endl;
@@ -444,58 +985,10 @@ void MyGLCanvas::loadSceneFile(const char* filenamePath) {
 }
 
 void MyGLCanvas::flatSceneData() {
-    flatSceneDataRec(parser->getRootNode(), glm::mat4(1.0f));
+    this->scene->flatten(parser->getRootNode(), glm::mat4(1.0f));
     this->scene->calculate();
 }
 
-void MyGLCanvas::flatSceneDataRec(SceneNode* node, glm::mat4 curMat) {
-    for (SceneTransformation* transform : node->transformations) {
-        switch (transform->type) {
-            case TRANSFORMATION_SCALE:
-                curMat = glm::scale(curMat, transform->scale);
-                break;
-            case TRANSFORMATION_ROTATE:
-                curMat = glm::rotate(curMat, transform->angle, transform->rotate);
-                break;
-            case TRANSFORMATION_TRANSLATE:
-                curMat = glm::translate(curMat, transform->translate);
-                break;
-            case TRANSFORMATION_MATRIX:
-                curMat = curMat * transform->matrix;
-                break;
-        }
-    }
-    for (ScenePrimitive* primitive : node->primitives){
-        switch (primitive->type) {
-            case SHAPE_CUBE:
-                this->scene->addNode(new SceneGraphNode(curMat, new Cube(), primitive->material));
-                break;
-            case SHAPE_CYLINDER:
-                this->scene->addNode(new SceneGraphNode(curMat, new Cylinder(), primitive->material));
-                break;
-            case SHAPE_CONE:
-                this->scene->addNode(new SceneGraphNode(curMat, new Cone(), primitive->material));
-                break;
-            case SHAPE_SPHERE:
-                this->scene->addNode(new SceneGraphNode(curMat, new Sphere(), primitive->material));
-                break;
-            case SHAPE_SPECIAL1:
-                this->scene->addNode(new SceneGraphNode(curMat, new Torus(), primitive->material));
-                break;
-            default:
-                this->scene->addNode(new SceneGraphNode(curMat, new Cube(), primitive->material));
-        }
-    }
-    if (node->children.size() == 0) {
-        return;
-    }
-    else {
-        for (SceneNode* child : node->children){
-            flatSceneDataRec(child, curMat);
-        }
-    }
-}
-
 void MyGLCanvas::setSegments() {
 	// set segments to be 20 for now
 	Shape::setSegments(this->segmentsX, this->segmentsY);
@@ -503,6 +996,7 @@ void MyGLCanvas::setSegments() {
 	if(this->scene != NULL) {
 		this->scene->calculate();
 	}
+	sceneVersion++;
 }
 
 void MyGLCanvas::bindMesh(std::vector<float>& array) {
@@ -643,47 +1137,18 @@ void MyGLCanvas::bindPLY(glm::mat4 mat) {
 	// printTreeBuffer(treeTextureBuffers[0], kdtreeArray.size());
 }
 
+// The full screen passes draw one triangle whose corners come from gl_VertexID, and the cloud
+// passes index their pixels the same way, so the VAO has no buffers; core profile only needs one bound.
 void MyGLCanvas::initializeVertexBuffer() {
-	// release
-    if (vao) {
-        glDeleteVertexArrays(1, &vao);
-        vao = 0;
-    }
-    if (vbo) {
-        glDeleteBuffers(1, &vbo);
-        vbo = 0;
-    }
-
-    pixelIndices.clear();
-    for (int j = 0; j < h(); j++) {
-        for (int i = 0; i < w(); i++) {
-            pixelIndices.push_back(float(i));
-            pixelIndices.push_back(float(j));
-        }
-    }
-
-    // VAO
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    // VBO
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-    // upload VBO
-    glBufferData(GL_ARRAY_BUFFER, pixelIndices.size() * sizeof(float), pixelIndices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-	// release
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+	if (vao == 0) {
+		glGenVertexArrays(1, &vao);
+	}
 }
 
 void MyGLCanvas::loadPLY(std::string filename) {
 	delete myObjectPLY;
 	myObjectPLY = new ply(filename);
+	sceneVersion++;
 	bindPLY(glm::mat4(1.0f));
 	camera->reset();
 	camera->setViewAngle(60.0f);
@@ -694,8 +1159,35 @@ void MyGLCanvas::loadPLY(std::string filename) {
 
 void MyGLCanvas::loadNoise(std::string filename) {
 	printf("loading noise file\n");
-	myTextureManager->deleteTexture("noiseTex");
-	myTextureManager->loadTexture3D("noiseTex", filename);
+	// upload a few slices per frame so large volumes do not stall the ui, the clouds keep
+	// the volume loaded before until then
+	if (myTextureManager->loadTexture3D("noiseTex", filename, 8) == 0) {
+		// not a tiled volume, keep clouds with generated noise
+		generateNoise();
+		return;
+	}
+	updateNoise();
+}
+
+// Cloud data derived from the noise volume in use, rebuilt when it is replaced
+void MyGLCanvas::updateNoise() {
+	noiseTextureSize = myTextureManager->getTexture("noiseTex")->getVolumeSize();
+	cloudGridDirty = true;
+	cloudLightNoiseDirty = true;
+	sceneVersion++;
+}
+
+// generate a perlin-worley volume in place of the tiled noise file
+void MyGLCanvas::generateNoise() {
+	printf("generating %d^3 noise with %d octaves\n", noiseResolution, noiseOctaves);
+	CloudNoiseParams params;
+	params.resolution = noiseResolution;
+	params.octaves = noiseOctaves;
+	myTextureManager->addTexture3D("noiseTex", generateCloudNoise(params), noiseResolution);
+	noiseTextureSize = noiseResolution;
+	cloudGridDirty = true;
+	cloudLightNoiseDirty = true;
+	sceneVersion++;
 }
 
 void MyGLCanvas::loadPlane() {
@@ -705,6 +1197,7 @@ void MyGLCanvas::loadPlane() {
 	std::string pwd(cwd);
 	std::cout << pwd + "/data/ply/airplane.ply" << endl;
 	myObjectPLY = new ply(pwd + "/data/ply/airplane.ply");
+	sceneVersion++;
 	glm::mat4 mat(1.0f);
 	mat = glm::rotate(mat, TO_RADIANS(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 	mat = glm::rotate(mat, TO_RADIANS(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
@@ -717,20 +1210,25 @@ void MyGLCanvas::loadPlane() {
 }
 
 void MyGLCanvas::initializeFBO(int width, int height) {
+    const TargetFormats& formats = RENDER_QUALITY_TARGETS[renderQuality];
+
     // use GL_TEXTURE1 gen color buffer
     glActiveTexture(GL_TEXTURE1);
     glGenTextures(1, &colorTexID);
     glBindTexture(GL_TEXTURE_2D, colorTexID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, formats.color, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    // linear so the environment pass can upscale it, exact at texel centers
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glBindTexture(GL_TEXTURE_2D, 0);
 
     // use GL_TEXTURE2 gen distance buffer
     glActiveTexture(GL_TEXTURE2);
     glGenTextures(1, &distanceTexID);
     glBindTexture(GL_TEXTURE_2D, distanceTexID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, formats.distance, width, height, 0, GL_RED, GL_FLOAT, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -759,15 +1257,17 @@ void MyGLCanvas::initializeFBO(int width, int height) {
 }
 
 void MyGLCanvas::resizeFBO(int width, int height) {
+    const TargetFormats& formats = RENDER_QUALITY_TARGETS[renderQuality];
+
     // GL_TEXTURE1 for colorTexID
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, colorTexID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, formats.color, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
 
     // GL_TEXTURE2 for distanceTexID
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, distanceTexID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, formats.distance, width, height, 0, GL_RED, GL_FLOAT, nullptr);
 
     // release
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -776,37 +1276,490 @@ void MyGLCanvas::resizeFBO(int width, int height) {
     glActiveTexture(GL_TEXTURE0);
 }
 
-void MyGLCanvas::readFBOData(int width, int height) {
-    // 确保绑定了 FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+void MyGLCanvas::setCloudScale(int scale) {
+	cloudScale = scale < 1 ? 1 : scale;
+	cloudTargetDirty = true;
+}
+
+// Picks the target formats; the targets are reallocated before the next frame
+void MyGLCanvas::setRenderQuality(int quality) {
+	renderQuality = quality < 0 ? 0 : (quality >= RENDER_QUALITY_COUNT ? RENDER_QUALITY_COUNT - 1 : quality);
+	renderQualityDirty = true;
+	printf("render quality: %s targets, %d bytes per pixel\n", RENDER_QUALITY_TARGETS[renderQuality].name,
+		RENDER_QUALITY_TARGETS[renderQuality].bytesPerPixel);
+}
 
-    // 创建缓冲区存储数据
-    std::vector<float> colorBuffer(width * height * 4); // RGBA，每像素4个值
-    std::vector<float> distanceBuffer(width * height);  // 距离值，每像素1个值
-
-    // 从 COLOR_ATTACHMENT0 读取颜色数据
-    glReadBuffer(GL_COLOR_ATTACHMENT0);
-    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, colorBuffer.data());
-
-    // 从 COLOR_ATTACHMENT1 读取距离数据
-    glReadBuffer(GL_COLOR_ATTACHMENT1);
-    glReadPixels(0, 0, width, height, GL_RED, GL_FLOAT, distanceBuffer.data());
-
-    // 找到前10个大于0的距离值并打印对应的颜色值
-    std::cout << "Distance > 0 and corresponding Color:" << std::endl;
-    int nonZeroCount = 0;
-    for (int i = 0; i < width * height && nonZeroCount < 10; ++i) {
-        if (distanceBuffer[i] > 0.0f) { // 条件：distance > 0
-            int idx = i * 4; // 计算对应的 colorBuffer 索引
-            std::cout << "Pixel " << i << ": Distance=" << distanceBuffer[i]
-                      << ", Color(R,G,B,A)=(" << colorBuffer[idx] << ", "
-                      << colorBuffer[idx + 1] << ", "
-                      << colorBuffer[idx + 2] << ", "
-                      << colorBuffer[idx + 3] << ")" << std::endl;
-            ++nonZeroCount;
+// Jumps to another time, e.g. the next frame of a rendered sequence. Unlike animate the
+// jump counts as a change, so the clouds and the progressive average start over.
+void MyGLCanvas::setAnimationFrame(int frame) {
+	if (frame != animationFrame) {
+		animationFrame = frame;
+		sceneVersion++;
+	}
+}
+
+void MyGLCanvas::setCloudMarchStride(int stride) {
+	cloudMarchStride = stride < 1 ? 1 : (stride > 4 ? 4 : stride);
+	cloudTargetDirty = true;
+}
+
+void MyGLCanvas::initializeCloudFBO() {
+    // cloud color and the depth each cloud pixel was marched against, twice
+    glGenTextures(2, cloudTexIDs);
+    glGenTextures(2, cloudDepthTexIDs);
+    glGenTextures(1, &marchTexID);
+    glGenTextures(1, &marchStepsTexID);
+    resizeCloudFBO();
+
+    // blue noise start offsets, tiled over the cloud target
+    std::vector<unsigned char> blueNoise = generateBlueNoise(64);
+    glGenTextures(1, &blueNoiseTexID);
+    glBindTexture(GL_TEXTURE_2D, blueNoiseTexID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, 64, 64, 0, GL_RED, GL_UNSIGNED_BYTE, blueNoise.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(2, cloudFBOs);
+    GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    for (int i = 0; i < 2; i++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, cloudFBOs[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cloudTexIDs[i], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, cloudDepthTexIDs[i], 0);
+        glDrawBuffers(2, drawBuffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            printf("Cloud framebuffer not complete!\n");
         }
     }
 
-    // 恢复默认帧缓冲
+    glGenFramebuffers(1, &marchFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, marchFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, marchTexID, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, marchStepsTexID, 0);
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Cloud march framebuffer not complete!\n");
+    }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
+
+// cloud target is the window size divided by cloudScale, rounded up,
+// the march target is the cloud target divided by cloudMarchStride, rounded up
+void MyGLCanvas::resizeCloudFBO() {
+    cloudTargetWidth = (renderWidth + cloudScale - 1) / cloudScale;
+    cloudTargetHeight = (renderHeight + cloudScale - 1) / cloudScale;
+    marchWidth = (cloudTargetWidth + cloudMarchStride - 1) / cloudMarchStride;
+    marchHeight = (cloudTargetHeight + cloudMarchStride - 1) / cloudMarchStride;
+
+    for (int i = 0; i < 2; i++) {
+        // history is sampled between pixels when reprojected
+        glBindTexture(GL_TEXTURE_2D, cloudTexIDs[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, cloudTargetWidth, cloudTargetHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glBindTexture(GL_TEXTURE_2D, cloudDepthTexIDs[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, cloudTargetWidth, cloudTargetHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, marchTexID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, marchWidth, marchHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, marchStepsTexID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, marchWidth, marchHeight, 0, GL_RG, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    cloudTargetDirty = false;
+    cloudHistoryValid = false;
+}
+
+// Position of this frame's marched pixel inside its cloudMarchStride x cloudMarchStride block.
+// The blocks are walked in bayer order so consecutive frames march pixels far apart.
+static glm::ivec2 marchOffset(int frame, int stride) {
+	static const int bayer2[4] = { 0, 3, 1, 2 };
+	static const int bayer4[16] = { 0, 10, 2, 8, 5, 15, 7, 13, 1, 11, 3, 9, 4, 14, 6, 12 };
+	int index = 0;
+	if (stride == 2) {
+		index = bayer2[frame % 4];
+	}
+	else if (stride == 4) {
+		index = bayer4[frame % 16];
+	}
+	else if (stride > 1) {
+		index = frame % (stride * stride);
+	}
+	return glm::ivec2(index % stride, index / stride);
+}
+
+// Marches one cloud ray per cloudScale x cloudScale block, and only one block out of every
+// cloudMarchStride x cloudMarchStride per frame. resolveClouds fills in the others.
+void MyGLCanvas::drawClouds() {
+	if (cloudTargetDirty) {
+		resizeCloudFBO();
+	}
+	if (cloudGridDirty) {
+		updateCloudGrid();
+	}
+	updateCloudLight();
+
+	CloudUniforms& c = cloudUniforms;
+	glBindFramebuffer(GL_FRAMEBUFFER, marchFBO);
+	glViewport(0, 0, marchWidth, marchHeight);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_DEPTH_TEST);
+	cloudProgram->use();
+	glBindVertexArray(vao);
+
+	// noise on GL_TEXTURE0, full resolution distance on GL_TEXTURE2
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, myTextureManager->getTextureID("noiseTex"));
+	cloudProgram->set(c.noiseTex, 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, distanceTexID);
+	cloudProgram->set(c.distanceMap, 2);
+
+	// empty space grid on GL_TEXTURE7
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_3D, cloudGridTexID);
+	cloudProgram->set(c.cloudGrid, 7);
+	cloudProgram->set(c.cloudGridCells, cloudGridCells);
+	cloudProgram->set(c.skipEmpty, cloudSkipEmpty && cloudGridTexID != 0 ? 1 : 0);
+
+	// light transmittance on GL_TEXTURE8, shifted by the drift since it was built
+	float drift = sampleRange > 0.0f ? (animationFrame - cloudLightBuilt.frame) * cloudSpeed / sampleRange : 0.0f;
+	glActiveTexture(GL_TEXTURE8);
+	glBindTexture(GL_TEXTURE_3D, cloudLightTexID);
+	cloudProgram->set(c.cloudLight, 8);
+	cloudProgram->set(c.cloudLightShift, glm::vec3(drift, -drift, drift));
+	cloudProgram->set(c.cloudLightValid, cloudLightValid ? 1 : 0);
+
+	// blue noise on GL_TEXTURE9
+	glActiveTexture(GL_TEXTURE9);
+	glBindTexture(GL_TEXTURE_2D, blueNoiseTexID);
+	cloudProgram->set(c.blueNoise, 9);
+
+	cloudProgram->set(c.frameCounter, frameCounter);
+	cloudProgram->set(c.animationFrame, animationFrame);
+
+	// pass march data
+	glm::ivec2 offset = marchOffset(frameCounter, cloudMarchStride);
+	cloudProgram->set(c.march.marchSize, marchWidth, marchHeight);
+	cloudProgram->set(c.march.marchStride, cloudMarchStride);
+	cloudProgram->set(c.march.marchOffset, offset.x, offset.y);
+
+	glDrawArrays(GL_POINTS, 0, marchWidth * marchHeight);
+
+	// step statistics with the cloud steps heatmap, the readback stalls so not every frame
+	if (costView == 4 && frameCounter % COST_STATS_INTERVAL == 0) {
+		printCloudStats();
+	}
+
+	// release
+	glEnable(GL_DEPTH_TEST);
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	glViewport(0, 0, w(), h());
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// Rebuilds the empty space grid from the noise volume. The grid lives in noise coordinates,
+// so sampleRange, cloudSpeed and the box only change how the shader walks it,
+// and the density threshold is applied in the shader; only new noise needs a rebuild.
+void MyGLCanvas::updateCloudGrid() {
+	cloudGridDirty = false;
+	ppm* noise = myTextureManager->getTexture("noiseTex");
+	if (noise == NULL) {
+		return;
+	}
+	clock_t start = clock();
+	cloudGridCells = noiseTextureSize / 8 < 1 ? 1 : noiseTextureSize / 8;
+
+	// base layer samples the noise at coord, the first detail layer at 3 * coord
+	std::vector<unsigned char> base = buildNoiseMaxGrid(noise, noiseTextureSize, cloudGridCells, 1);
+	std::vector<unsigned char> detail = buildNoiseMaxGrid(noise, noiseTextureSize, cloudGridCells, 3);
+	if (base.empty() || detail.empty()) {
+		printf("cloud grid: noise has no pixels, empty space skipping disabled\n");
+		glDeleteTextures(1, &cloudGridTexID);
+		cloudGridTexID = 0;
+		return;
+	}
+	std::vector<unsigned char> grid(base.size() * 2);
+	size_t emptyCells = 0;
+	for (size_t i = 0; i < base.size(); i++) {
+		grid[2 * i] = base[i];
+		grid[2 * i + 1] = detail[i];
+		// empty even with full detail, the shader decides per step with the real detail factor
+		if (base[i] / 255.0f * 0.55f + detail[i] / 255.0f * 0.25f + 0.1875f <= 0.45f) {
+			emptyCells++;
+		}
+	}
+
+	if (cloudGridTexID == 0) {
+		glGenTextures(1, &cloudGridTexID);
+	}
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_3D, cloudGridTexID);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RG8, cloudGridCells, cloudGridCells, cloudGridCells, 0, GL_RG, GL_UNSIGNED_BYTE, grid.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_3D, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	printf("cloud grid: %d^3 cells, %zu empty at full detail (%.1f ms)\n", cloudGridCells, emptyCells,
+		1000.0 * (clock() - start) / CLOCKS_PER_SEC);
+}
+
+static bool sameCloudLight(const CloudLightParams& a, const CloudLightParams& b) {
+	return a.width == b.width && a.bottom == b.bottom && a.top == b.top && a.sampleRange == b.sampleRange &&
+		a.cloudSpeed == b.cloudSpeed && a.cloudDensity == b.cloudDensity && a.absorption == b.absorption &&
+		a.lightPos[0] == b.lightPos[0] && a.lightPos[1] == b.lightPos[1] && a.lightPos[2] == b.lightPos[2];
+}
+
+// Uploads a finished light volume and starts the next one when needed. The shader shifts
+// the volume along with the clouds, so it is only rebuilt once the drift exceeds two voxels
+// in height, where the fade at the box top and bottom starts to disagree.
+void MyGLCanvas::updateCloudLight() {
+	if (cloudLightThread.joinable()) {
+		if (!cloudLightReady) {
+			return;
+		}
+		cloudLightThread.join();
+		cloudLightBuilt = cloudLightPending;
+		if (cloudLightTexID == 0) {
+			glGenTextures(1, &cloudLightTexID);
+		}
+		glActiveTexture(GL_TEXTURE8);
+		glBindTexture(GL_TEXTURE_3D, cloudLightTexID);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, cloudLightBuilt.sizeX, cloudLightBuilt.sizeY, cloudLightBuilt.sizeZ, 0,
+			GL_RED, GL_FLOAT, cloudLightVolume.data());
+		glBindTexture(GL_TEXTURE_3D, 0);
+		glActiveTexture(GL_TEXTURE0);
+		cloudLightValid = true;
+		sceneVersion++;
+	}
+
+	CloudLightParams params;
+	params.width = cloudWidth;
+	params.bottom = cloudBottom;
+	params.top = cloudTop;
+	params.sampleRange = sampleRange;
+	params.cloudSpeed = cloudSpeed;
+	params.cloudDensity = cloudDensity;
+	params.frame = animationFrame;
+	params.lightPos[0] = lightPos.x;
+	params.lightPos[1] = lightPos.y;
+	params.lightPos[2] = lightPos.z;
+	params.absorption = cloudLightAbsorption;
+
+	float drift = sampleRange > 0.0f ? std::fabs((animationFrame - cloudLightBuilt.frame) * cloudSpeed / sampleRange) : 0.0f;
+	float voxelHeight = (cloudTop - cloudBottom) / cloudLightBuilt.sizeY;
+	if (cloudLightValid && !cloudLightNoiseDirty && sameCloudLight(params, cloudLightBuilt) && drift <= 2.0f * voxelHeight) {
+		return;
+	}
+
+	// the worker gets its own copy of the noise, the texture may be replaced while it runs
+	ppm* noise = myTextureManager->getTexture("noiseTex");
+	std::vector<unsigned char> volume;
+	if (noise != NULL) {
+		volume = readNoiseVolume(noise, noiseTextureSize);
+	}
+	cloudLightNoiseDirty = false;
+	if (volume.empty()) {
+		cloudLightValid = false;
+		return;
+	}
+	cloudLightPending = params;
+	cloudLightReady = false;
+	int size = noiseTextureSize;
+	cloudLightThread = std::thread([this, size](std::vector<unsigned char> noiseVolume) {
+		cloudLightVolume = buildCloudTransmittance(noiseVolume, size, cloudLightPending);
+		cloudLightReady = true;
+	}, std::move(volume));
+}
+
+// Averages the step counters of the last march over the rays that entered the cloud box.
+// Only called while the cost view shows cloud steps, glReadPixels waits for the march.
+void MyGLCanvas::printCloudStats() {
+	std::vector<float> steps((size_t)marchWidth * marchHeight * 2);
+	glReadBuffer(GL_COLOR_ATTACHMENT1);
+	glReadPixels(0, 0, marchWidth, marchHeight, GL_RG, GL_FLOAT, steps.data());
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+	double densitySteps = 0.0, skippedCells = 0.0;
+	int rays = 0;
+	for (size_t i = 0; i < steps.size(); i += 2) {
+		if (steps[i] + steps[i + 1] > 0.0f) {
+			densitySteps += steps[i];
+			skippedCells += steps[i + 1];
+			rays++;
+		}
+	}
+	if (rays > 0) {
+		printf("clouds: %d rays, %.1f density steps and %.1f skipped cells per ray (skipping %s)\n",
+			rays, densitySteps / rays, skippedCells / rays, cloudSkipEmpty ? "on" : "off");
+	}
+}
+
+// Temporal resolve: writes the next cloud target from this frame's marched pixels and
+// the previous target reprojected through the previous camera.
+void MyGLCanvas::resolveClouds() {
+	int current = 1 - cloudHistoryIndex;
+	CloudResolveUniforms& r = cloudResolveUniforms;
+	glBindFramebuffer(GL_FRAMEBUFFER, cloudFBOs[current]);
+	glViewport(0, 0, cloudTargetWidth, cloudTargetHeight);
+	glDisable(GL_DEPTH_TEST);
+	cloudResolveProgram->use();
+	glBindVertexArray(vao);
+
+	// marched pixels on GL_TEXTURE0, distance on GL_TEXTURE2, history on GL_TEXTURE5 and GL_TEXTURE6
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, marchTexID);
+	cloudResolveProgram->set(r.marchMap, 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, distanceTexID);
+	cloudResolveProgram->set(r.distanceMap, 2);
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_2D, cloudTexIDs[cloudHistoryIndex]);
+	cloudResolveProgram->set(r.historyMap, 5);
+	glActiveTexture(GL_TEXTURE6);
+	glBindTexture(GL_TEXTURE_2D, cloudDepthTexIDs[cloudHistoryIndex]);
+	cloudResolveProgram->set(r.historyDepthMap, 6);
+	cloudResolveProgram->set(r.historyValid, cloudHistoryValid ? 1 : 0);
+
+	// pass the previous camera, the current one is in the camera block
+	cloudResolveProgram->set(r.prevEyePosition, prevEyePosition);
+	cloudResolveProgram->set(r.prevLookVec, prevLookVec);
+	cloudResolveProgram->set(r.prevUpVec, prevUpVec);
+	cloudResolveProgram->set(r.cloudSize, cloudTargetWidth, cloudTargetHeight);
+	cloudResolveProgram->set(r.driftFrames, float(animationFrame - prevAnimationFrame));
+
+	// pass march data
+	glm::ivec2 offset = marchOffset(frameCounter, cloudMarchStride);
+	cloudResolveProgram->set(r.march.marchSize, marchWidth, marchHeight);
+	cloudResolveProgram->set(r.march.marchStride, cloudMarchStride);
+	cloudResolveProgram->set(r.march.marchOffset, offset.x, offset.y);
+
+	glDrawArrays(GL_POINTS, 0, cloudTargetWidth * cloudTargetHeight);
+
+	// the target just written is next frame's history
+	cloudHistoryIndex = current;
+	cloudHistoryValid = true;
+	prevEyePosition = camera->getEyePoint();
+	prevLookVec = camera->getLookVector();
+	prevUpVec = camera->getUpVector();
+	prevAnimationFrame = animationFrame;
+
+	// release
+	glEnable(GL_DEPTH_TEST);
+	glViewport(0, 0, w(), h());
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// Third attachment of fbo at the render resolution, one float per counter so every count is exact
+void MyGLCanvas::updateCostTarget() {
+	if (costTexID != 0 && costWidth == renderWidth && costHeight == renderHeight) {
+		return;
+	}
+	if (costTexID == 0) {
+		glGenTextures(1, &costTexID);
+	}
+	costWidth = renderWidth;
+	costHeight = renderHeight;
+	glBindTexture(GL_TEXTURE_2D, costTexID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, costWidth, costHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, costTexID, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Framebuffer not complete!\n");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Mean, percentiles and a power of two histogram of one counter. Returns the 99th percentile.
+static float printCostHistogram(const char* name, std::vector<float>& counts) {
+	if (counts.empty()) {
+		return 0.0f;
+	}
+	std::sort(counts.begin(), counts.end());
+	double sum = 0.0;
+	int buckets[17] = {};	// 0, 1, 2-3, 4-7, ..., 32768 and above
+	for (float count : counts) {
+		sum += count;
+		int bucket = 0;
+		for (int value = (int)count; value > 0 && bucket < 16; value >>= 1) {
+			bucket++;
+		}
+		buckets[bucket]++;
+	}
+	auto percentile = [&counts](double p) { return counts[std::min((size_t)(p * counts.size()), counts.size() - 1)]; };
+	printf("%s: mean %.1f, p50 %.0f, p95 %.0f, p99 %.0f, max %.0f\n  histogram", name, sum / counts.size(),
+		percentile(0.50), percentile(0.95), percentile(0.99), counts.back());
+	for (int bucket = 0; bucket < 17; bucket++) {
+		if (buckets[bucket] > 0) {
+			int low = bucket == 0 ? 0 : 1 << (bucket - 1);
+			printf(" [%d+] %.1f%%", low, 100.0 * buckets[bucket] / counts.size());
+		}
+	}
+	printf("\n");
+	return percentile(0.99);
+}
+
+// Reads the counters back, prints their statistics and scales each heatmap to its 99th percentile.
+// This stalls on the GPU, so it only runs every COST_STATS_INTERVAL frames of the cost view.
+void MyGLCanvas::readCostStats() {
+	std::vector<float> pixels((size_t)costWidth * costHeight * 4);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT2);
+	glReadPixels(0, 0, costWidth, costHeight, GL_RGBA, GL_FLOAT, pixels.data());
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+	std::vector<float> steps((size_t)marchWidth * marchHeight * 2);
+	glBindFramebuffer(GL_FRAMEBUFFER, marchFBO);
+	glReadBuffer(GL_COLOR_ATTACHMENT1);
+	glReadPixels(0, 0, marchWidth, marchHeight, GL_RG, GL_FLOAT, steps.data());
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	const char* names[4] = { "kd-tree nodes", "triangles", "sea steps", "cloud steps" };
+	printf("cost per pixel at %d x %d\n", costWidth, costHeight);
+	for (int counter = 0; counter < 4; counter++) {
+		std::vector<float> counts;
+		if (counter < 3) {
+			counts.reserve((size_t)costWidth * costHeight);
+			for (size_t i = counter; i < pixels.size(); i += 4) {
+				counts.push_back(pixels[i]);
+			}
+		}
+		else {
+			counts.reserve((size_t)marchWidth * marchHeight);
+			for (size_t i = 0; i < steps.size(); i += 2) {
+				counts.push_back(steps[i] + steps[i + 1]);
+			}
+		}
+		costScale[counter] = std::max(1.0f, printCostHistogram(names[counter], counts));
+	}
+}
@@ -1,6 +1,7 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <math.h>
 #include <FL/Fl.H>
 #include <FL/Fl_Window.H>
@@ -8,6 +9,9 @@
 #include <FL/Fl_Pack.H>
 #include <FL/Fl_Check_Button.H>
 #include <FL/Fl_Value_Slider.H>
+#include <FL/Fl_Value_Output.H>
+#include <FL/Fl_Choice.H>
+#include <FL/Fl_Browser.H>
 #include <FL/Fl_File_Chooser.H>
 #include <FL/Fl_Gl_Window.H>
 #include <FL/names.h>
@@ -37,6 +41,26 @@ public:
 	Fl_Slider* cloudSpeedSlider;
 	Fl_Slider* cloudDensitySlider;
 	Fl_Slider* sampleRangeSlider;
+	Fl_Slider* lightAbsorptionSlider;
+	Fl_Slider* cloudStepSizeSlider;
+	Fl_Choice* cloudResolutionChoice;
+	Fl_Choice* cloudTemporalChoice;
+
+	// render
+	Fl_Choice* renderQualityChoice;
+	Fl_Slider* frameBudgetSlider;
+	Fl_Value_Output* renderScaleOutput;
+	Fl_Slider* progressiveSamplesSlider;
+	Fl_Value_Output* samplesOutput;
+	Fl_Slider* animationFPSSlider;
+
+	// gpu profile, in its own window
+	Fl_Check_Button* profileButton;
+	Fl_Choice* costViewChoice;
+	Fl_Window* profileWindow;
+	Fl_Browser* profileBrowser;
+	Fl_Button* exportProfileButton;
+	int profileTicks;
 	// rotate
 	Fl_Slider* rotUSlider;
 	Fl_Slider* rotVSlider;
@@ -62,6 +86,11 @@ public:
 	Fl_Slider* segmentsXSlider;
 	Fl_Slider* segmentsYSlider;
 
+	// cloud noise
+	Fl_Slider* noiseResolutionSlider;
+	Fl_Slider* noiseOctavesSlider;
+	Fl_Button* generateNoiseButton;
+
 	MyGLCanvas* canvas;
 	TextureManager* myTextureManager;
 
@@ -69,8 +98,30 @@ public:
 	// APP WINDOW CONSTRUCTOR
 	MyAppWindow(int W, int H, const char* L = 0);
 
-	static void idleCB(void* userdata) {
-		win->canvas->redraw();
+	// frame scheduler: at most animationFPS times per second, the canvas is redrawn when input,
+	// a widget or the animation changed what it shows, and not at all while the window is iconified
+	int animationFPS;
+
+	static void frameCB(void* userdata) {
+		if (!win->visible()) {
+			Fl::repeat_timeout(0.25, frameCB);
+			return;
+		}
+		if (win->canvas->needsRedraw()) {
+			win->canvas->redraw();
+		}
+		if (win->renderScaleOutput->value() != win->canvas->renderScale) {
+			win->renderScaleOutput->value(win->canvas->renderScale);
+		}
+		if (win->samplesOutput->value() != win->canvas->accumulatedSamples) {
+			win->samplesOutput->value(win->canvas->accumulatedSamples);
+		}
+		// the profile is refreshed about four times a second
+		if (win->profileWindow->shown() && ++win->profileTicks >= std::max(win->animationFPS / 4, 1)) {
+			win->profileTicks = 0;
+			updateProfile();
+		}
+		Fl::repeat_timeout(1.0 / std::max(win->animationFPS, 1), frameCB);
 	}
 
     int handle(int event) override {
@@ -127,6 +178,8 @@ private:
 		cloudSpeedSlider->value(canvas->cloudSpeed);
 		cloudDensitySlider->value(canvas->cloudDensity);
 		sampleRangeSlider->value(canvas->sampleRange);
+		lightAbsorptionSlider->value(canvas->cloudLightAbsorption);
+		cloudStepSizeSlider->value(canvas->cloudStepSize);
 
 		rotUSlider->value(canvas->camera->rotU);
 		rotVSlider->value(canvas->camera->rotV);
@@ -144,6 +197,10 @@ private:
 		*((int*)userdata) = value;
 	}
 
+	static void intSliderCB(Fl_Widget* w, void* userdata) {
+		*((int*)userdata) = (int)((Fl_Slider*)w)->value();
+	}
+
 	static void reloadCB(Fl_Widget* w, void* userdata) {
 		win->canvas->reloadShaders();
 	}
@@ -207,6 +264,12 @@ private:
 		win->canvas->redraw();
 	}
 
+	static void generateNoiseCB(Fl_Widget* w, void* data) {
+		win->canvas->make_current();
+		win->canvas->generateNoise();
+		win->canvas->redraw();
+	}
+
 	static void loadPlaneCB(Fl_Widget* w, void* data) {
 		win->canvas->loadPlane();
 		win->canvas->redraw();
@@ -279,6 +342,71 @@ private:
 		printf("sampleRange: %f\n", win->canvas->sampleRange);
 	}
 
+	static void cloudResolutionCB(Fl_Widget* w, void* userdata) {
+		// Full, Half, Quarter
+		win->canvas->setCloudScale(1 << ((Fl_Choice*)w)->value());
+	}
+
+	static void cloudTemporalCB(Fl_Widget* w, void* userdata) {
+		// Off, 1/4, 1/16 of the cloud pixels marched per frame
+		win->canvas->setCloudMarchStride(1 << ((Fl_Choice*)w)->value());
+	}
+
+	// rolling statistics of every pass, in ms
+	static void updateProfile() {
+		GpuProfiler* profiler = win->canvas->getProfiler();
+		if (profiler == NULL) {
+			return;
+		}
+		char line[128];
+		win->profileBrowser->clear();
+		win->profileBrowser->add("@bstage\t@bmean\t@bp50\t@bp95\t@bp99\t@bmax");
+		for (int stage = 0; stage <= profiler->getStageCount(); stage++) {
+			GpuProfiler::Stats stats = profiler->getStats(stage);
+			const char* name = stage < profiler->getStageCount() ? profiler->getStageName(stage).c_str() : "@bframe";
+			snprintf(line, sizeof(line), "%s\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f", name, stats.mean, stats.p50, stats.p95, stats.p99, stats.max);
+			win->profileBrowser->add(line);
+		}
+		snprintf(line, sizeof(line), "%d frames, %d x %d", profiler->getStats(0).samples, win->canvas->w(), win->canvas->h());
+		win->profileBrowser->add(line);
+	}
+
+	static void profileCB(Fl_Widget* w, void* userdata) {
+		if (((Fl_Button*)w)->value()) {
+			win->profileWindow->show();
+			updateProfile();
+		}
+		else {
+			win->profileWindow->hide();
+		}
+	}
+
+	static void profileWindowCB(Fl_Widget* w, void* userdata) {
+		win->profileWindow->hide();
+		win->profileButton->value(0);
+	}
+
+	static void exportProfileCB(Fl_Widget* w, void* userdata) {
+		GpuProfiler* profiler = win->canvas->getProfiler();
+		if (profiler == NULL) {
+			return;
+		}
+		const char* filename = fl_file_chooser("Export GPU Profile", "*.csv", "profile.csv");
+		if (filename != NULL && profiler->writeCSV(filename)) {
+			printf("gpu profile written to %s\n", filename);
+		}
+	}
+
+	static void costViewCB(Fl_Widget* w, void* userdata) {
+		// Off, KD-Tree Nodes, Triangles, Sea Steps, Cloud Steps
+		win->canvas->costView = ((Fl_Choice*)w)->value();
+	}
+
+	static void renderQualityCB(Fl_Widget* w, void* userdata) {
+		// Low, Medium, High
+		win->canvas->setRenderQuality(((Fl_Choice*)w)->value());
+	}
+
 	static void cameraRotateCB(Fl_Widget* w, void* userdata) {
 		win->canvas->camera->setRotUVW(win->rotUSlider->value(), win->rotVSlider->value(), win->rotWSlider->value());
 	}
@@ -287,6 +415,7 @@ private:
 
 
 MyAppWindow::MyAppWindow(int W, int H, const char* L) : Fl_Window(W, H, L) {
+	animationFPS = 60;
 	begin();
 
 	canvas = new MyGLCanvas(10, 10, w() - 470, h() - 20);
@@ -307,6 +436,21 @@ MyAppWindow::MyAppWindow(int W, int H, const char* L) : Fl_Window(W, H, L) {
 			reloadButton = new Fl_Button(0, 0, packCol1->w() - 20, 20, "Reload");
 			reloadButton->callback(reloadCB, (void*)this);
 
+			//toggle for the window with the GPU time of each pass
+			profileButton = new Fl_Check_Button(0, 0, packCol1->w() - 20, 20, "GPU Profile");
+			profileButton->callback(profileCB, (void*)this);
+
+			//choice for the heatmap of the work per pixel
+			Fl_Box *costViewTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Cost View");
+			costViewChoice = new Fl_Choice(0, 0, packCol1->w() - 20, 20, "");
+			costViewChoice->add("Off");
+			costViewChoice->add("KD-Tree Nodes");
+			costViewChoice->add("Triangles");
+			costViewChoice->add("Sea Steps");
+			costViewChoice->add("Cloud Steps");
+			costViewChoice->value(canvas->costView);
+			costViewChoice->callback(costViewCB, (void*)this);
+
 		packShaders->end();
 
 		Fl_Pack* loadPack = new Fl_Pack(w() - 100, 30, 100, h(), "Scene Files");
@@ -396,6 +540,49 @@ MyAppWindow::MyAppWindow(int W, int H, const char* L) : Fl_Window(W, H, L) {
 			sampleRangeSlider->step(1);
 			sampleRangeSlider->value(canvas->sampleRange);
 			sampleRangeSlider->callback(cloudCB, (void*)(&(canvas->sampleRange)));
+
+			//slider for controlling how much light the clouds absorb
+			Fl_Box *lightAbsorptionTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Light Absorption");
+			lightAbsorptionSlider = new Fl_Value_Slider(0, 0, packCol1->w() - 20, 20, "");
+			lightAbsorptionSlider->align(FL_ALIGN_TOP);
+			lightAbsorptionSlider->type(FL_HOR_SLIDER);
+			lightAbsorptionSlider->bounds(0, 10);
+			lightAbsorptionSlider->step(0.1);
+			lightAbsorptionSlider->value(canvas->cloudLightAbsorption);
+			lightAbsorptionSlider->callback(cloudCB, (void*)(&(canvas->cloudLightAbsorption)));
+
+			//slider for controlling the ray march step
+			Fl_Box *cloudStepSizeTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Cloud Step Size");
+			cloudStepSizeSlider = new Fl_Value_Slider(0, 0, packCol1->w() - 20, 20, "");
+			cloudStepSizeSlider->align(FL_ALIGN_TOP);
+			cloudStepSizeSlider->type(FL_HOR_SLIDER);
+			cloudStepSizeSlider->bounds(0.05, 0.5);
+			cloudStepSizeSlider->step(0.05);
+			cloudStepSizeSlider->value(canvas->cloudStepSize);
+			cloudStepSizeSlider->callback(cloudCB, (void*)(&(canvas->cloudStepSize)));
+
+			//choice for the resolution clouds are marched at
+			Fl_Box *cloudResolutionTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Cloud Resolution");
+			cloudResolutionChoice = new Fl_Choice(0, 0, packCol1->w() - 20, 20, "");
+			cloudResolutionChoice->add("Full");
+			cloudResolutionChoice->add("Half");
+			cloudResolutionChoice->add("Quarter");
+			cloudResolutionChoice->value(canvas->cloudScale == 4 ? 2 : canvas->cloudScale - 1);
+			cloudResolutionChoice->callback(cloudResolutionCB, (void*)this);
+
+			//choice for the share of cloud pixels marched each frame
+			Fl_Box *cloudTemporalTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Cloud Temporal");
+			cloudTemporalChoice = new Fl_Choice(0, 0, packCol1->w() - 20, 20, "");
+			cloudTemporalChoice->add("Off");
+			cloudTemporalChoice->add("1/4");
+			cloudTemporalChoice->add("1/16");
+			cloudTemporalChoice->value(canvas->cloudMarchStride == 4 ? 2 : canvas->cloudMarchStride - 1);
+			cloudTemporalChoice->callback(cloudTemporalCB, (void*)this);
+
+			//toggle for leaping over noise cells that can not hold cloud
+			Fl_Check_Button* skipEmptyButton = new Fl_Check_Button(0, 0, packCol1->w() - 20, 20, "Skip Empty Space");
+			skipEmptyButton->value(canvas->cloudSkipEmpty);
+			skipEmptyButton->callback(intCB, (void*)(&(canvas->cloudSkipEmpty)));
 		radioPack->end();
 
 		
@@ -535,15 +722,133 @@ MyAppWindow::MyAppWindow(int W, int H, const char* L) : Fl_Window(W, H, L) {
 		
 		segmentsPack->end();
 
+		Fl_Pack* noisePack = new Fl_Pack(w() - 100, 30, 100, h(), "Cloud Noise");
+		noisePack->box(FL_DOWN_FRAME);
+		noisePack->labelfont(1);
+		noisePack->type(Fl_Pack::VERTICAL);
+		noisePack->spacing(0);
+		noisePack->begin();
+
+			Fl_Box *noiseResolutionTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Resolution");
+			noiseResolutionSlider = new Fl_Value_Slider(0, 0, packCol1->w() - 20, 20, "");
+			noiseResolutionSlider->align(FL_ALIGN_TOP);
+			noiseResolutionSlider->type(FL_HOR_SLIDER);
+			noiseResolutionSlider->bounds(32, 256);
+			noiseResolutionSlider->step(32);
+			noiseResolutionSlider->value(canvas->noiseResolution);
+			noiseResolutionSlider->callback(intSliderCB, (void*)(&(canvas->noiseResolution)));
+
+			Fl_Box *noiseOctavesTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Octaves");
+			noiseOctavesSlider = new Fl_Value_Slider(0, 0, packCol1->w() - 20, 20, "");
+			noiseOctavesSlider->align(FL_ALIGN_TOP);
+			noiseOctavesSlider->type(FL_HOR_SLIDER);
+			noiseOctavesSlider->bounds(1, 6);
+			noiseOctavesSlider->step(1);
+			noiseOctavesSlider->value(canvas->noiseOctaves);
+			noiseOctavesSlider->callback(intSliderCB, (void*)(&(canvas->noiseOctaves)));
+
+			generateNoiseButton = new Fl_Button(0, 0, packCol1->w() - 20, 20, "Generate Noise");
+			generateNoiseButton->callback(generateNoiseCB, (void*)this);
+
+		noisePack->end();
+
+		Fl_Pack* renderPack = new Fl_Pack(w() - 100, 30, 100, h(), "Render");
+		renderPack->box(FL_DOWN_FRAME);
+		renderPack->labelfont(1);
+		renderPack->type(Fl_Pack::VERTICAL);
+		renderPack->spacing(0);
+		renderPack->begin();
+
+			//choice for the precision of the targets between the object and environment passes
+			Fl_Box *renderQualityTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Render Quality");
+			renderQualityChoice = new Fl_Choice(0, 0, packCol1->w() - 20, 20, "");
+			renderQualityChoice->add("Low");
+			renderQualityChoice->add("Medium");
+			renderQualityChoice->add("High");
+			renderQualityChoice->value(canvas->renderQuality);
+			renderQualityChoice->callback(renderQualityCB, (void*)this);
+
+			//toggle for scaling the render resolution to the frame budget
+			Fl_Check_Button* dynamicResolutionButton = new Fl_Check_Button(0, 0, packCol1->w() - 20, 20, "Dynamic Resolution");
+			dynamicResolutionButton->value(canvas->dynamicResolution);
+			dynamicResolutionButton->callback(intCB, (void*)(&(canvas->dynamicResolution)));
+
+			Fl_Box *frameBudgetTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Frame Budget (ms)");
+			frameBudgetSlider = new Fl_Value_Slider(0, 0, packCol1->w() - 20, 20, "");
+			frameBudgetSlider->align(FL_ALIGN_TOP);
+			frameBudgetSlider->type(FL_HOR_SLIDER);
+			frameBudgetSlider->bounds(4, 50);
+			frameBudgetSlider->step(0.1);
+			frameBudgetSlider->value(canvas->frameBudget);
+			frameBudgetSlider->callback(floatCB, (void*)(&(canvas->frameBudget)));
+
+			//active render scale, updated by the frameCB timeout
+			Fl_Box *renderScaleTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Render Scale");
+			renderScaleOutput = new Fl_Value_Output(0, 0, packCol1->w() - 20, 20, "");
+			renderScaleOutput->precision(2);
+			renderScaleOutput->value(canvas->renderScale);
+
+			//toggle for averaging jittered frames while the view stays still
+			Fl_Check_Button* progressiveButton = new Fl_Check_Button(0, 0, packCol1->w() - 20, 20, "Progressive Refinement");
+			progressiveButton->value(canvas->progressive);
+			progressiveButton->callback(intCB, (void*)(&(canvas->progressive)));
+
+			Fl_Box *progressiveSamplesTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Max Samples");
+			progressiveSamplesSlider = new Fl_Value_Slider(0, 0, packCol1->w() - 20, 20, "");
+			progressiveSamplesSlider->align(FL_ALIGN_TOP);
+			progressiveSamplesSlider->type(FL_HOR_SLIDER);
+			progressiveSamplesSlider->bounds(1, 256);
+			progressiveSamplesSlider->step(1);
+			progressiveSamplesSlider->value(canvas->progressiveSamples);
+			progressiveSamplesSlider->callback(intSliderCB, (void*)(&(canvas->progressiveSamples)));
+
+			//samples averaged so far, updated by the frameCB timeout
+			Fl_Box *samplesTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Samples");
+			samplesOutput = new Fl_Value_Output(0, 0, packCol1->w() - 20, 20, "");
+			samplesOutput->value(canvas->accumulatedSamples);
+
+			//toggle for the ocean and cloud animation, without it frames are only drawn on changes
+			Fl_Check_Button* animateButton = new Fl_Check_Button(0, 0, packCol1->w() - 20, 20, "Animate");
+			animateButton->value(canvas->animate);
+			animateButton->callback(intCB, (void*)(&(canvas->animate)));
+
+			Fl_Box *animationFPSTextbox = new Fl_Box(0, 0, packCol1->w() - 20, 20, "Max FPS");
+			animationFPSSlider = new Fl_Value_Slider(0, 0, packCol1->w() - 20, 20, "");
+			animationFPSSlider->align(FL_ALIGN_TOP);
+			animationFPSSlider->type(FL_HOR_SLIDER);
+			animationFPSSlider->bounds(1, 144);
+			animationFPSSlider->step(1);
+			animationFPSSlider->value(animationFPS);
+			animationFPSSlider->callback(intSliderCB, (void*)(&animationFPS));
+
+		renderPack->end();
+
 	packCol3->end();
 
 	end();
+
+	// profile window, shown by the GPU Profile toggle
+	profileTicks = 0;
+	static int profileColumns[] = { 110, 50, 50, 50, 50, 50, 0 };
+	profileWindow = new Fl_Window(380, 200, "GPU Profile");
+	profileWindow->callback(profileWindowCB, (void*)this);
+	profileWindow->begin();
+
+		profileBrowser = new Fl_Browser(5, 5, 370, 160, "");
+		profileBrowser->column_widths(profileColumns);
+		profileBrowser->column_char('\t');
+		profileBrowser->textfont(FL_COURIER);
+
+		exportProfileButton = new Fl_Button(5, 170, 120, 25, "Export CSV");
+		exportProfileButton->callback(exportProfileCB, (void*)this);
+
+	profileWindow->end();
 }
 
 int main(int argc, char** argv) {
 	win = new MyAppWindow(1000, 475, "Environment Mapping");
 	win->resizable(win);
-	Fl::add_idle(MyAppWindow::idleCB);
+	Fl::add_timeout(0.0, MyAppWindow::frameCB);
 	win->show();
 	return(Fl::run());
 }
@@ -50,9 +50,9 @@ void Mesh::clear() {
     for (int i = 0; i < lastF; i++) {
         if (faces[i] != nullptr) delete faces[i];
     }
-    delete vertices;
-    delete edges;
-    delete faces;
+    delete[] vertices;
+    delete[] edges;
+    delete[] faces;
 }
 
 void Mesh::calculateVertexNormal() {
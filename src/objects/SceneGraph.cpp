@@ -1,4 +1,10 @@
 #include "objects/SceneGraph.h"
+#include "objects/Cube.h"
+#include "objects/Cone.h"
+#include "objects/Cylinder.h"
+#include "objects/Sphere.h"
+#include "objects/Torus.h"
+#include <glm/gtc/matrix_transform.hpp>
 
 KDTreeNode* KDTree::build(std::vector<SceneGraphNode*>& objects, int depth) {
     if (objects.empty()) return nullptr;
@@ -136,6 +142,57 @@ bool SceneGraphNode::buildArray(std::vector<float>& array) {
     return true;
 }
 
+void SceneGraph::flatten(SceneNode* node, glm::mat4 curMat) {
+    for (SceneTransformation* transform : node->transformations) {
+        switch (transform->type) {
+            case TRANSFORMATION_SCALE:
+                curMat = glm::scale(curMat, transform->scale);
+                break;
+            case TRANSFORMATION_ROTATE:
+                // a zero axis (scenes write <rotate x="0" y="0" z="0" angle="0"/>) would turn every vertex into NaN
+                if (transform->angle != 0.0f && glm::length(transform->rotate) > 0.0f) {
+                    curMat = glm::rotate(curMat, transform->angle, transform->rotate);
+                }
+                break;
+            case TRANSFORMATION_TRANSLATE:
+                curMat = glm::translate(curMat, transform->translate);
+                break;
+            case TRANSFORMATION_MATRIX:
+                curMat = curMat * transform->matrix;
+                break;
+        }
+    }
+    for (ScenePrimitive* primitive : node->primitives){
+        switch (primitive->type) {
+            case SHAPE_CUBE:
+                this->addNode(new SceneGraphNode(curMat, new Cube(), primitive->material));
+                break;
+            case SHAPE_CYLINDER:
+                this->addNode(new SceneGraphNode(curMat, new Cylinder(), primitive->material));
+                break;
+            case SHAPE_CONE:
+                this->addNode(new SceneGraphNode(curMat, new Cone(), primitive->material));
+                break;
+            case SHAPE_SPHERE:
+                this->addNode(new SceneGraphNode(curMat, new Sphere(), primitive->material));
+                break;
+            case SHAPE_SPECIAL1:
+                this->addNode(new SceneGraphNode(curMat, new Torus(), primitive->material));
+                break;
+            default:
+                this->addNode(new SceneGraphNode(curMat, new Cube(), primitive->material));
+        }
+    }
+    if (node->children.size() == 0) {
+        return;
+    }
+    else {
+        for (SceneNode* child : node->children){
+            flatten(child, curMat);
+        }
+    }
+}
+
 bool SceneGraph::buildArray(std::vector<float>& array) {
     for (auto node : this->list) {
         if (!node->buildArray(array)) {
@@ -173,24 +230,33 @@ int meshKDTree::buildRec(const std::vector<float>& array, std::vector<int>& face
         return nodes.size() - 1;
     }
 
-    // split meshes
-    int axis = depth % 3;
-    vector<float> centers;
-    for (int i : faceIndexes) { centers.push_back((array[i * 18 + 0 + axis] + array[i * 18 + 3 + axis] + array[i * 18 + 6 + axis]) / 3); }
-    std::sort(centers.begin(), centers.end());
-    float mid = centers[centers.size() / 2];
-    // float mid = (node.min_xyz[axis] + node.max_xyz[axis]) / 2;
-    // printf("mid: %f\n", mid);
+    // split meshes, on the next axes when every center lies on the median
     std::vector<int> left_indexes, right_indexes;
-    for (int index : faceIndexes) {
-        float center = (array[index * 18 + 0 + axis] + array[index * 18 + 3 + axis] + array[index * 18 + 6 + axis]) / 3;
-        if (center < mid) {
-            left_indexes.push_back(index);
-        }
-        else {
-            right_indexes.push_back(index);
+    for (int attempt = 0; attempt < 3 && (left_indexes.empty() || right_indexes.empty()); attempt++) {
+        int axis = (depth + attempt) % 3;
+        vector<float> centers;
+        for (int i : faceIndexes) { centers.push_back((array[i * 18 + 0 + axis] + array[i * 18 + 3 + axis] + array[i * 18 + 6 + axis]) / 3); }
+        std::sort(centers.begin(), centers.end());
+        float mid = centers[centers.size() / 2];
+        // float mid = (node.min_xyz[axis] + node.max_xyz[axis]) / 2;
+        // printf("mid: %f\n", mid);
+        left_indexes.clear();
+        right_indexes.clear();
+        for (int index : faceIndexes) {
+            float center = (array[index * 18 + 0 + axis] + array[index * 18 + 3 + axis] + array[index * 18 + 6 + axis]) / 3;
+            if (center < mid) {
+                left_indexes.push_back(index);
+            }
+            else {
+                right_indexes.push_back(index);
+            }
         }
     }
+    // no axis separates them, halve them in order instead of recursing forever
+    if (left_indexes.empty() || right_indexes.empty()) {
+        left_indexes.assign(faceIndexes.begin(), faceIndexes.begin() + faceIndexes.size() / 2);
+        right_indexes.assign(faceIndexes.begin() + faceIndexes.size() / 2, faceIndexes.end());
+    }
     // create left and right node
     node.left = buildRec(array, left_indexes, depth + 1, max_triangles_per_leaf);
     node.right = buildRec(array, right_indexes, depth + 1, max_triangles_per_leaf);
@@ -240,3 +306,55 @@ void meshKDTree::buildArray(std::vector<float>& array) {
         }
     }
 }
+
+// Surface area of a box, 0 for an empty one
+static float boxArea(const float* min_xyz, const float* max_xyz) {
+    float dx = max_xyz[0] - min_xyz[0], dy = max_xyz[1] - min_xyz[1], dz = max_xyz[2] - min_xyz[2];
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f) {
+        return 0.0f;
+    }
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+meshKDTreeStats meshKDTree::getStats() const {
+    meshKDTreeStats stats;
+    stats.nodes = (int)nodes.size();
+    if (nodes.empty()) {
+        return stats;
+    }
+    const meshKDTreeNode& root = nodes[rootIndex];
+    float rootArea = boxArea(root.min_xyz, root.max_xyz);
+    long long leafDepthSum = 0, leafTriangleSum = 0;
+    double cost = 0.0;
+
+    // depth first from the root
+    std::vector<std::pair<int, int>> stack = { { rootIndex, 0 } };
+    while (!stack.empty()) {
+        int index = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        const meshKDTreeNode& node = nodes[index];
+        // probability that a ray through the root box hits this box
+        float hit = rootArea > 0.0f ? boxArea(node.min_xyz, node.max_xyz) / rootArea : 1.0f;
+        stats.maxDepth = std::max(stats.maxDepth, depth);
+        if (node.left == -1) {
+            int triangles = (int)node.faceIndexes.size();
+            stats.leaves++;
+            stats.emptyLeaves += triangles == 0 ? 1 : 0;
+            stats.truncatedLeaves += triangles > 6 ? 1 : 0;
+            stats.maxLeafTriangles = std::max(stats.maxLeafTriangles, triangles);
+            leafDepthSum += depth;
+            leafTriangleSum += triangles;
+            cost += hit * (1.0 + std::min(triangles, 6));
+        }
+        else {
+            cost += hit;
+            stack.push_back({ node.left, depth + 1 });
+            stack.push_back({ node.right, depth + 1 });
+        }
+    }
+    stats.meanLeafDepth = (float)leafDepthSum / stats.leaves;
+    stats.meanLeafTriangles = (float)leafTriangleSum / stats.leaves;
+    stats.sahCost = (float)cost;
+    return stats;
+}
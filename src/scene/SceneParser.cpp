@@ -8,7 +8,9 @@
 #include "scene/SceneData.h"
 
 #include <string>
+#include <stdexcept>
 #include <glm/gtc/type_ptr.hpp>
+#include "shaders/ppm.h"
 
 /*XML Parsing Headers */
 #include "scene/tinyxml.h"
@@ -1055,44 +1057,38 @@ Texture::Texture(const std::string& filename) : filename(filename), width(0), he
     loadFromFile(filename);
 }
 
-// Simplified loadFromFile implementation
+// Load the PPM through the shared ppm reader and keep its 8-bit texels
 void Texture::loadFromFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file) {
+    ppm image(filename);
+    if (image.getPixels() == NULL || image.getWidth() <= 0 || image.getHeight() <= 0) {
         throw std::runtime_error("Could not open the file: " + filename);
     }
-
-    // Skip the fixed header
-    std::string line;
-    std::getline(file, line); // "P3"
-    std::getline(file, line); // Comment line
-    std::getline(file, line); // Dimensions
-    std::istringstream dimensions(line);
-    dimensions >> width >> height;
-
-    std::getline(file, line); // Max color value (e.g., 255)
-    int maxColorValue = std::stoi(line);
-
-    // Read pixel data
-    int r, g, b;
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            file >> r >> g >> b;
-            glm::vec3 color(r / static_cast<float>(maxColorValue),
-                            g / static_cast<float>(maxColorValue),
-                            b / static_cast<float>(maxColorValue));
-            colors[{x, y}] = color;
-        }
-    }
+    width = image.getWidth();
+    height = image.getHeight();
+    const unsigned char* pixels = (const unsigned char*)image.getPixels();
+    texels.assign(pixels, pixels + (size_t)width * height * 3);
 }
 
 // Get color at a specific coordinate
 glm::vec3 Texture::getColor(float u, float v, float repeatU, float repeatV) const {
-   float s = (u * repeatU - floor(u * repeatU)) * width;
-   float t = (v * repeatV - floor(v * repeatV)) * height;
-   auto it = colors.find({s, t});
-   if (it != colors.end()) {
-      return it->second;
+   if (texels.empty()) {
+      throw std::out_of_range("Pixel coordinates out of range.");
    }
-   throw std::out_of_range("Pixel coordinates out of range.");
-}
\ No newline at end of file
+   // texel centers sit at half integers
+   float s = (u * repeatU - floor(u * repeatU)) * width - 0.5f;
+   float t = (v * repeatV - floor(v * repeatV)) * height - 0.5f;
+   float s0 = floor(s);
+   float t0 = floor(t);
+   float fs = s - s0;
+   float ft = t - t0;
+
+   // wrap neighbours so that sampling repeats seamlessly
+   int x0 = ((int)s0 % width + width) % width;
+   int y0 = ((int)t0 % height + height) % height;
+   int x1 = (x0 + 1) % width;
+   int y1 = (y0 + 1) % height;
+
+   glm::vec3 top = glm::mix(getTexel(x0, y0), getTexel(x1, y0), fs);
+   glm::vec3 bottom = glm::mix(getTexel(x0, y1), getTexel(x1, y1), fs);
+   return glm::mix(top, bottom, ft);
+}
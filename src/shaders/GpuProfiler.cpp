@@ -0,0 +1,133 @@
+#include "shaders/GpuProfiler.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+GpuProfiler::GpuProfiler(const std::vector<std::string>& stageNames, int window)
+    : stageNames(stageNames), next(0), pending(0), measuring(false), running(-1),
+      window(std::max(window, 1)), historyNext(0), historyCount(0) {
+    queries.resize(FRAME_COUNT * stageNames.size());
+    issued.assign(queries.size(), 0);
+    glGenQueries((GLsizei)queries.size(), queries.data());
+    history.assign(stageNames.size() + 1, std::vector<float>(this->window, 0.0f));
+}
+
+GpuProfiler::~GpuProfiler() {
+    glDeleteQueries((GLsizei)queries.size(), queries.data());
+}
+
+void GpuProfiler::beginFrame() {
+    measuring = pending < FRAME_COUNT;
+    if (measuring) {
+        std::fill(issued.begin() + next * stageNames.size(), issued.begin() + (next + 1) * stageNames.size(), 0);
+    }
+}
+
+void GpuProfiler::endFrame() {
+    end();
+    if (!measuring) {
+        return;
+    }
+    measuring = false;
+    next = (next + 1) % FRAME_COUNT;
+    pending++;
+}
+
+void GpuProfiler::begin(int stage) {
+    end();
+    if (!measuring || stage < 0 || stage >= getStageCount()) {
+        return;
+    }
+    size_t index = next * stageNames.size() + stage;
+    glBeginQuery(GL_TIME_ELAPSED, queries[index]);
+    issued[index] = 1;
+    running = stage;
+}
+
+void GpuProfiler::end() {
+    if (running < 0) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    running = -1;
+}
+
+bool GpuProfiler::poll(double& frameMilliseconds) {
+    bool found = false;
+    size_t stages = stageNames.size();
+    while (pending > 0) {
+        // frames finish in order, and a frame is done once its last issued query is
+        int frame = (next - pending + FRAME_COUNT) % FRAME_COUNT;
+        int last = -1;
+        for (size_t stage = 0; stage < stages; stage++) {
+            if (issued[frame * stages + stage]) {
+                last = (int)stage;
+            }
+        }
+        if (last >= 0) {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[frame * stages + last], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+        }
+        double total = 0.0;
+        for (size_t stage = 0; stage < stages; stage++) {
+            double milliseconds = 0.0;
+            if (issued[frame * stages + stage]) {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(queries[frame * stages + stage], GL_QUERY_RESULT, &nanoseconds);
+                milliseconds = nanoseconds / 1.0e6;
+            }
+            history[stage][historyNext] = (float)milliseconds;
+            total += milliseconds;
+        }
+        history[stages][historyNext] = (float)total;
+        historyNext = (historyNext + 1) % window;
+        historyCount = std::min(historyCount + 1, window);
+        frameMilliseconds = total;
+        found = true;
+        pending--;
+    }
+    return found;
+}
+
+GpuProfiler::Stats GpuProfiler::getStats(int stage) const {
+    Stats stats = {};
+    if (stage < 0 || stage > getStageCount() || historyCount == 0) {
+        return stats;
+    }
+    std::vector<float> samples(history[stage].begin(), history[stage].begin() + historyCount);
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (float sample : samples) {
+        sum += sample;
+    }
+    // nearest rank
+    auto percentile = [&samples](double p) {
+        size_t rank = (size_t)std::max(0.0, p * samples.size() - 1e-9);
+        return (double)samples[std::min(rank, samples.size() - 1)];
+    };
+    stats.samples = historyCount;
+    stats.mean = sum / historyCount;
+    stats.p50 = percentile(0.50);
+    stats.p95 = percentile(0.95);
+    stats.p99 = percentile(0.99);
+    stats.max = samples.back();
+    return stats;
+}
+
+bool GpuProfiler::writeCSV(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file) {
+        std::cerr << "Unable to write " << filename << std::endl;
+        return false;
+    }
+    file << "stage,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+    for (int stage = 0; stage <= getStageCount(); stage++) {
+        Stats stats = getStats(stage);
+        file << (stage < getStageCount() ? stageNames[stage] : "frame") << "," << stats.samples << ","
+             << stats.mean << "," << stats.p50 << "," << stats.p95 << "," << stats.p99 << "," << stats.max << "\n";
+    }
+    return true;
+}
@@ -166,6 +166,9 @@ void ShaderManager::addShaderProgram(const char* programName, const char* vertex
 	// Now we finally decide to use the program
 	//glUseProgram(program->programID);
 
+	// Look up every active uniform once, so drawing never has to ask OpenGL by name
+	program->reflectUniforms();
+
 	shaderPrograms[programName] = program;
 }
 
@@ -10,6 +10,9 @@
 #endif
 #include <FL/glut.h>
 #include <FL/glu.h>
+#include <cstdio>
+#include <cstring>
+#include <glm/gtc/type_ptr.hpp>
 
 
 ShaderProgram::ShaderProgram() {
@@ -34,4 +37,115 @@ ShaderProgram::~ShaderProgram() {
 	if (programID != -1) {
 		glDeleteProgram(programID);
 	}
-}
\ No newline at end of file
+}
+
+void ShaderProgram::reflectUniforms() {
+	uniforms.clear();
+	uniformIndex.clear();
+
+	GLint count = 0;
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+	for (GLint i = 0; i < count; i++) {
+		char buffer[256];
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(programID, i, sizeof(buffer), &length, &size, &type, buffer);
+		std::string name(buffer, length);
+		// arrays are reported as "name[0]", register every element and the bare name
+		bool isArray = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+		std::string base = isArray ? name.substr(0, name.size() - 3) : name;
+		for (GLint element = 0; element < size; element++) {
+			UniformState state;
+			state.name = isArray ? base + "[" + std::to_string(element) + "]" : base;
+			state.location = glGetUniformLocation(programID, state.name.c_str());
+			state.type = type;
+			state.hasValue = false;
+			state.warned = false;
+			if (state.location < 0) {
+				continue;	// uniform block members have no location
+			}
+			uniformIndex[state.name] = (int)uniforms.size();
+			if (isArray && element == 0) {
+				uniformIndex[base] = (int)uniforms.size();
+			}
+			uniforms.push_back(state);
+		}
+	}
+}
+
+ShaderProgram::Uniform ShaderProgram::getUniform(const std::string& name) const {
+	Uniform uniform;
+	auto it = uniformIndex.find(name);
+	if (it != uniformIndex.end()) {
+		uniform.index = it->second;
+	}
+	return uniform;
+}
+
+void ShaderProgram::use() {
+	glUseProgram(programID);
+}
+
+bool ShaderProgram::update(Uniform uniform, const void* value, size_t bytes, unsigned int type) {
+	if (!uniform.valid()) {
+		return false;
+	}
+	UniformState& state = uniforms[uniform.index];
+	// samplers are set as ints
+	bool sampler = state.type == GL_SAMPLER_2D || state.type == GL_SAMPLER_3D || state.type == GL_SAMPLER_BUFFER ||
+		state.type == GL_INT_SAMPLER_BUFFER || state.type == GL_UNSIGNED_INT_SAMPLER_BUFFER;
+	if (state.type != type && !(sampler && type == GL_INT) && !state.warned) {
+		printf("uniform %s: type 0x%x set as 0x%x\n", state.name.c_str(), state.type, type);
+		state.warned = true;
+	}
+	if (state.hasValue && memcmp(state.cache, value, bytes) == 0) {
+		return false;
+	}
+	memcpy(state.cache, value, bytes);
+	state.hasValue = true;
+	return true;
+}
+
+void ShaderProgram::set(Uniform uniform, int value) {
+	if (update(uniform, &value, sizeof(value), GL_INT)) {
+		glUniform1i(uniforms[uniform.index].location, value);
+	}
+}
+
+void ShaderProgram::set(Uniform uniform, float value) {
+	if (update(uniform, &value, sizeof(value), GL_FLOAT)) {
+		glUniform1f(uniforms[uniform.index].location, value);
+	}
+}
+
+void ShaderProgram::set(Uniform uniform, int x, int y) {
+	int value[2] = { x, y };
+	if (update(uniform, value, sizeof(value), GL_INT_VEC2)) {
+		glUniform2i(uniforms[uniform.index].location, x, y);
+	}
+}
+
+void ShaderProgram::set(Uniform uniform, const glm::vec2& value) {
+	if (update(uniform, glm::value_ptr(value), sizeof(value), GL_FLOAT_VEC2)) {
+		glUniform2fv(uniforms[uniform.index].location, 1, glm::value_ptr(value));
+	}
+}
+
+void ShaderProgram::set(Uniform uniform, const glm::vec3& value) {
+	if (update(uniform, glm::value_ptr(value), sizeof(value), GL_FLOAT_VEC3)) {
+		glUniform3fv(uniforms[uniform.index].location, 1, glm::value_ptr(value));
+	}
+}
+
+void ShaderProgram::set(Uniform uniform, const glm::vec4& value) {
+	if (update(uniform, glm::value_ptr(value), sizeof(value), GL_FLOAT_VEC4)) {
+		glUniform4fv(uniforms[uniform.index].location, 1, glm::value_ptr(value));
+	}
+}
+
+void ShaderProgram::set(Uniform uniform, const glm::mat4& value) {
+	if (update(uniform, glm::value_ptr(value), sizeof(value), GL_FLOAT_MAT4)) {
+		glUniformMatrix4fv(uniforms[uniform.index].location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+}
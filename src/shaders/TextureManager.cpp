@@ -27,6 +27,10 @@ TextureManager ::~TextureManager(){
 		delete it.second;  //delete the memory of the ShaderProgram object
 	}
 	textures.clear();  
+	for (auto const& it : previousTextures) {
+		delete it.second;
+	}
+	previousTextures.clear();
 }
 
 /*	===============================================
@@ -47,17 +51,65 @@ void TextureManager::loadTexture(string textureName, string fileName) {
 	textures[textureName] = curPPM;  //add the newly added texture to the map
 }
 
-void TextureManager::loadTexture3D(string textureName, string fileName) {
+int TextureManager::loadTexture3D(string textureName, string fileName, int slicesPerFrame) {
 	ppm* curPPM = NULL;
 	auto it = textures.find(textureName);
 	if (it == textures.end()) {  //ppm not found
 		curPPM = new ppm(fileName);
 	}
+	else if (slicesPerFrame > 0) {
+		// the texture loaded before stays in use until the new one is complete, unless it is
+		// itself an upload that has not finished
+		if (pendingUploads.count(textureName) != 0) {
+			delete it->second;
+		}
+		else {
+			delete getPreviousTexture(textureName);
+			previousTextures[textureName] = it->second;
+		}
+		curPPM = new ppm(fileName);
+	}
 	else {
 		curPPM = it->second;
 	}
-	curPPM->bindTexture3D(128);
+	int size = curPPM->getVolumeSize();
+	if (size == 0 && curPPM->getWidth() > 0) {
+		cout << fileName << ": " << curPPM->getWidth() << " x " << curPPM->getHeight() << " is no tiled cube" << endl;
+	}
+	// with nothing to show meanwhile, every slice is uploaded right away
+	if (slicesPerFrame > 0 && getPreviousTexture(textureName) != NULL) {
+		curPPM->beginTexture3D(size);
+		pendingUploads[textureName] = slicesPerFrame;
+	}
+	else {
+		curPPM->bindTexture3D(size);
+		pendingUploads.erase(textureName);
+	}
 	textures[textureName] = curPPM;  //add the newly added texture to the map
+	return size;
+}
+
+void TextureManager::addTexture3D(string textureName, ppm* image, unsigned int sizeT) {
+	deleteTexture(textureName);
+	image->bindTexture3D(sizeT);
+	textures[textureName] = image;
+}
+
+bool TextureManager::updateTextures() {
+	bool updated = false;
+	for (auto it = pendingUploads.begin(); it != pendingUploads.end();) {
+		auto tex = textures.find(it->first);
+		if (tex == textures.end() || tex->second->uploadTexture3DSlices(it->second)) {
+			delete getPreviousTexture(it->first);
+			previousTextures.erase(it->first);
+			it = pendingUploads.erase(it);
+			updated = true;
+		}
+		else {
+			++it;
+		}
+	}
+	return updated;
 }
 
 void TextureManager::deleteTexture(string textureName) {
@@ -67,10 +119,17 @@ void TextureManager::deleteTexture(string textureName) {
 		delete it->second;
 		textures.erase(it); //erasing the entry by key 
 	}
+	delete getPreviousTexture(textureName);
+	previousTextures.erase(textureName);
+	pendingUploads.erase(textureName);
 }
 
 
 unsigned int TextureManager::getTextureID(std::string textureName) {
+	ppm* previous = getPreviousTexture(textureName);
+	if (previous != NULL) {
+		return previous->getTextureID();
+	}
 	auto it = textures.find(textureName);
 	if (it == textures.end()) {  //ppm not found
 		cout << "texutre name not found!!!" << endl;
@@ -79,3 +138,22 @@ unsigned int TextureManager::getTextureID(std::string textureName) {
 	return it->second->getTextureID();
 }
 
+ppm* TextureManager::getTexture(std::string textureName) {
+	ppm* previous = getPreviousTexture(textureName);
+	if (previous != NULL) {
+		return previous;
+	}
+	auto it = textures.find(textureName);
+	if (it == textures.end()) {
+		return NULL;
+	}
+	return it->second;
+}
+
+ppm* TextureManager::getPreviousTexture(std::string textureName) {
+	auto it = previousTextures.find(textureName);
+	if (it == previousTextures.end()) {
+		return NULL;
+	}
+	return it->second;
+}
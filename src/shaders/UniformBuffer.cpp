@@ -0,0 +1,37 @@
+#include <iostream>
+#include <cstring>
+#include "shaders/UniformBuffer.h"
+
+UniformBuffer::UniformBuffer(GLuint bindingPoint, size_t size) : bindingPoint(bindingPoint), size(size), contents(size, 0) {
+    glGenBuffers(1, &bufferID);
+    glBindBuffer(GL_UNIFORM_BUFFER, bufferID);
+    glBufferData(GL_UNIFORM_BUFFER, size, contents.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, bufferID);
+}
+
+UniformBuffer::~UniformBuffer() {
+    glDeleteBuffers(1, &bufferID);
+}
+
+void UniformBuffer::update(const void* data, size_t dataSize, size_t offset) {
+    if (offset + dataSize > size) {
+        std::cout << "UniformBuffer::update out of range (" << offset + dataSize << " > " << size << ")" << std::endl;
+        return;
+    }
+    if (memcmp(contents.data() + offset, data, dataSize) == 0) {
+        return;
+    }
+    memcpy(contents.data() + offset, data, dataSize);
+    glBindBuffer(GL_UNIFORM_BUFFER, bufferID);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, dataSize, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bindProgram(GLuint programID, const char* blockName) {
+    GLuint blockIndex = glGetUniformBlockIndex(programID, blockName);
+    if (blockIndex == GL_INVALID_INDEX) {
+        return;
+    }
+    glUniformBlockBinding(programID, blockIndex, bindingPoint);
+}
@@ -0,0 +1,171 @@
+#include <cmath>
+#include <algorithm>
+#include "shaders/cloudLight.h"
+#include "shaders/parallel.h"
+
+// Cloud light volume
+//
+// 1. Density:
+//    getDensity of cloud-frag.shader at the center of every voxel of the cloud box,
+//    with the noise scrolled to params.frame.
+//
+// 2. Transmittance:
+//    from every voxel center, march toward the light through the density voxels until
+//    the ray leaves the box, and keep exp(-absorption * optical depth).
+//
+// The light is usually far away compared to the box height, so a march crosses the
+// box in a few dozen steps. Slices are distributed over threads for both passes.
+
+namespace {
+
+inline int wrap(int v, int period) {
+    return ((v % period) + period) % period;
+}
+
+inline float smoothstep(float edge0, float edge1, float x) {
+    float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// GL_LINEAR + GL_REPEAT lookup of the noise volume, coord in periods
+float sampleNoise(const std::vector<unsigned char>& noise, int size, float x, float y, float z) {
+    x = x * size - 0.5f;
+    y = y * size - 0.5f;
+    z = z * size - 0.5f;
+    int ix = (int)std::floor(x), iy = (int)std::floor(y), iz = (int)std::floor(z);
+    float fx = x - ix, fy = y - iy, fz = z - iz;
+    int x0 = wrap(ix, size), x1 = wrap(ix + 1, size);
+    int y0 = wrap(iy, size), y1 = wrap(iy + 1, size);
+    int z0 = wrap(iz, size), z1 = wrap(iz + 1, size);
+    auto at = [&](int vx, int vy, int vz) {
+        return noise[((size_t)vz * size + vy) * size + vx] / 255.0f;
+    };
+    float c00 = at(x0, y0, z0) + (at(x1, y0, z0) - at(x0, y0, z0)) * fx;
+    float c10 = at(x0, y1, z0) + (at(x1, y1, z0) - at(x0, y1, z0)) * fx;
+    float c01 = at(x0, y0, z1) + (at(x1, y0, z1) - at(x0, y0, z1)) * fx;
+    float c11 = at(x0, y1, z1) + (at(x1, y1, z1) - at(x0, y1, z1)) * fx;
+    float c0 = c00 + (c10 - c00) * fy;
+    float c1 = c01 + (c11 - c01) * fy;
+    return c0 + (c1 - c0) * fz;
+}
+
+float density(const std::vector<unsigned char>& noise, int noiseSize, const CloudLightParams& p, float x, float y, float z) {
+    float scroll = p.frame * (p.cloudSpeed * 0.0001f);
+    float s = p.sampleRange * 0.0001f;
+    float cx = x * s + scroll;
+    float cy = y * s - scroll;
+    float cz = z * s + scroll;
+
+    // base and first detail layer at full detail, the finer two at their mean of 0.5
+    float n = sampleNoise(noise, noiseSize, cx, cy, cz) * 0.55f
+            + sampleNoise(noise, noiseSize, cx * 3.0f, cy * 3.0f, cz * 3.0f) * 0.25f
+            + (0.125f + 0.0625f) * 0.5f;
+    const float threshold = 0.45f;
+    n = std::max(n - threshold, 0.0f) * (1.0f / (1.0f - threshold));
+
+    float distToEdgeY = std::min(std::fabs(y - p.bottom), std::fabs(y - p.top));
+    float verticalWeight = smoothstep(0.0f, (p.top - p.bottom) * 0.5f, distToEdgeY);
+    n *= std::pow(verticalWeight, 4.0f);
+    return n < 0.01f / p.cloudDensity ? 0.0f : n;
+}
+
+}
+
+std::vector<unsigned char> readNoiseVolume(ppm* image, int size) {
+    const unsigned char* pixels = (const unsigned char*)image->getPixels();
+    int tiles = size > 0 ? image->getWidth() / size : 0;
+    if (!pixels || tiles == 0 || image->getHeight() / size * tiles < size) {
+        return std::vector<unsigned char>();
+    }
+    std::vector<unsigned char> volume((size_t)size * size * size);
+    for (int z = 0; z < size; z++) {
+        int tileX = (z % tiles) * size;
+        int tileY = (z / tiles) * size;
+        for (int y = 0; y < size; y++) {
+            const unsigned char* src = pixels + ((size_t)(tileY + y) * image->getWidth() + tileX) * 3;
+            unsigned char* dst = &volume[((size_t)z * size + y) * size];
+            for (int x = 0; x < size; x++) {
+                dst[x] = src[3 * x];
+            }
+        }
+    }
+    return volume;
+}
+
+std::vector<float> buildCloudTransmittance(const std::vector<unsigned char>& noise, int noiseSize, const CloudLightParams& p) {
+    int nx = std::max(p.sizeX, 2), ny = std::max(p.sizeY, 2), nz = std::max(p.sizeZ, 2);
+    std::vector<float> transmittance((size_t)nx * ny * nz, 1.0f);
+    if (noise.empty() || p.top <= p.bottom || p.width <= 0.0f) {
+        return transmittance;
+    }
+
+    float minX = -p.width, minY = p.bottom, minZ = -p.width;
+    float cellX = 2.0f * p.width / nx;
+    float cellY = (p.top - p.bottom) / ny;
+    float cellZ = 2.0f * p.width / nz;
+
+    std::vector<float> dens(transmittance.size());
+    parallelEach(nz, [&](int z) {
+        for (int y = 0; y < ny; y++) {
+            for (int x = 0; x < nx; x++) {
+                dens[((size_t)z * ny + y) * nx + x] = density(noise, noiseSize, p,
+                    minX + (x + 0.5f) * cellX, minY + (y + 0.5f) * cellY, minZ + (z + 0.5f) * cellZ);
+            }
+        }
+    });
+
+    // density at a position in voxel units, clamped to the box like GL_CLAMP_TO_EDGE
+    auto lookup = [&](float gx, float gy, float gz) {
+        gx = std::min(std::max(gx - 0.5f, 0.0f), nx - 1.0f);
+        gy = std::min(std::max(gy - 0.5f, 0.0f), ny - 1.0f);
+        gz = std::min(std::max(gz - 0.5f, 0.0f), nz - 1.0f);
+        int x0 = std::min((int)gx, nx - 2), y0 = std::min((int)gy, ny - 2), z0 = std::min((int)gz, nz - 2);
+        float fx = gx - x0, fy = gy - y0, fz = gz - z0;
+        auto at = [&](int vx, int vy, int vz) { return dens[((size_t)vz * ny + vy) * nx + vx]; };
+        float c00 = at(x0, y0, z0) + (at(x0 + 1, y0, z0) - at(x0, y0, z0)) * fx;
+        float c10 = at(x0, y0 + 1, z0) + (at(x0 + 1, y0 + 1, z0) - at(x0, y0 + 1, z0)) * fx;
+        float c01 = at(x0, y0, z0 + 1) + (at(x0 + 1, y0, z0 + 1) - at(x0, y0, z0 + 1)) * fx;
+        float c11 = at(x0, y0 + 1, z0 + 1) + (at(x0 + 1, y0 + 1, z0 + 1) - at(x0, y0 + 1, z0 + 1)) * fx;
+        float c0 = c00 + (c10 - c00) * fy;
+        float c1 = c01 + (c11 - c01) * fy;
+        return c0 + (c1 - c0) * fz;
+    };
+
+    parallelEach(nz, [&](int z) {
+        for (int y = 0; y < ny; y++) {
+            for (int x = 0; x < nx; x++) {
+                float px = minX + (x + 0.5f) * cellX;
+                float py = minY + (y + 0.5f) * cellY;
+                float pz = minZ + (z + 0.5f) * cellZ;
+                float lx = p.lightPos[0] - px, ly = p.lightPos[1] - py, lz = p.lightPos[2] - pz;
+                float length = std::sqrt(lx * lx + ly * ly + lz * lz);
+                if (length < 1e-6f) {
+                    continue;
+                }
+                lx /= length; ly /= length; lz /= length;
+
+                // half a voxel per step along the axis the light direction crosses voxels fastest
+                float step = 0.5f / std::max(std::max(std::fabs(lx) / cellX, std::fabs(ly) / cellY), std::fabs(lz) / cellZ);
+
+                // distance to where the light ray leaves the box, or reaches the light
+                float exit = length;
+                float dir[3] = { lx, ly, lz };
+                float pos[3] = { px, py, pz };
+                float lo[3] = { minX, minY, minZ };
+                float hi[3] = { p.width, p.top, p.width };
+                for (int i = 0; i < 3; i++) {
+                    if (dir[i] > 0.0f) exit = std::min(exit, (hi[i] - pos[i]) / dir[i]);
+                    else if (dir[i] < 0.0f) exit = std::min(exit, (lo[i] - pos[i]) / dir[i]);
+                }
+
+                float opticalDepth = 0.0f;
+                for (float t = step * 0.5f; t < exit; t += step) {
+                    float ds = std::min(step, exit - t + step * 0.5f);
+                    opticalDepth += lookup((px + lx * t - minX) / cellX, (py + ly * t - minY) / cellY, (pz + lz * t - minZ) / cellZ) * ds;
+                }
+                transmittance[((size_t)z * ny + y) * nx + x] = std::exp(-p.absorption * opticalDepth);
+            }
+        }
+    });
+    return transmittance;
+}
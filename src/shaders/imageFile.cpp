@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "shaders/imageFile.h"
+
+// PNG: signature, IHDR, one IDAT holding a zlib stream of stored deflate blocks, IEND.
+// Every row starts with filter byte 0.
+//
+// EXR: magic and version, header attributes, a table with the offset of every scanline,
+// then the scanlines, each one the channels B, G, R (alphabetical, as the format wants)
+// of width floats. All numbers are little endian.
+
+namespace {
+
+void put32BE(std::vector<unsigned char>& out, uint32_t value) {
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+void put32LE(std::vector<unsigned char>& out, uint32_t value) {
+    out.push_back((unsigned char)value);
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 24));
+}
+
+void put64LE(std::vector<unsigned char>& out, uint64_t value) {
+    put32LE(out, (uint32_t)value);
+    put32LE(out, (uint32_t)(value >> 32));
+}
+
+void putFloatLE(std::vector<unsigned char>& out, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put32LE(out, bits);
+}
+
+void putString(std::vector<unsigned char>& out, const char* text) {
+    out.insert(out.end(), text, text + strlen(text) + 1);
+}
+
+uint32_t crc32(const unsigned char* data, size_t length, uint32_t crc = 0) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> values(256);
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            values[n] = c;
+        }
+        return values;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// chunk length, type, data and the crc of type and data
+void putChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data) {
+    put32BE(out, (uint32_t)data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put32BE(out, crc32(&out[start], out.size() - start));
+}
+
+// attribute name, type name, size and value of an EXR header
+void putAttribute(std::vector<unsigned char>& out, const char* name, const char* type, const std::vector<unsigned char>& value) {
+    putString(out, name);
+    putString(out, type);
+    put32LE(out, (uint32_t)value.size());
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+bool writeFile(const std::string& fileName, const std::vector<unsigned char>& bytes) {
+    FILE* file = fopen(fileName.c_str(), "wb");
+    if (file == NULL) {
+        printf("Unable to write image file: %s\n", fileName.c_str());
+        return false;
+    }
+    bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return fclose(file) == 0 && written;
+}
+
+}
+
+bool writePNG(const std::string& fileName, int width, int height, const std::vector<unsigned char>& rgb) {
+    if (width <= 0 || height <= 0 || rgb.size() != (size_t)width * height * 3) {
+        return false;
+    }
+    std::vector<unsigned char> raw;
+    raw.reserve((size_t)(width * 3 + 1) * height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + (size_t)y * width * 3, rgb.begin() + (size_t)(y + 1) * width * 3);
+    }
+
+    // zlib header, stored blocks of at most 65535 bytes, adler32 of the raw data
+    std::vector<unsigned char> zlib = { 0x78, 0x01 };
+    size_t offset = 0;
+    do {
+        size_t length = std::min<size_t>(raw.size() - offset, 65535);
+        zlib.push_back(offset + length == raw.size() ? 1 : 0);
+        zlib.push_back((unsigned char)length);
+        zlib.push_back((unsigned char)(length >> 8));
+        zlib.push_back((unsigned char)~length);
+        zlib.push_back((unsigned char)(~length >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+        offset += length;
+    } while (offset < raw.size());
+    uint32_t a = 1, b = 0;
+    for (unsigned char value : raw) {
+        a = (a + value) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32BE(zlib, (b << 16) | a);
+
+    std::vector<unsigned char> header;
+    put32BE(header, (uint32_t)width);
+    put32BE(header, (uint32_t)height);
+    header.insert(header.end(), { 8, 2, 0, 0, 0 });     // 8 bit, RGB, deflate, no filter method, no interlace
+
+    std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    putChunk(png, "IHDR", header);
+    putChunk(png, "IDAT", zlib);
+    putChunk(png, "IEND", {});
+    return writeFile(fileName, png);
+}
+
+bool writeEXR(const std::string& fileName, int width, int height, const std::vector<float>& rgb) {
+    if (width <= 0 || height <= 0 || rgb.size() != (size_t)width * height * 3) {
+        return false;
+    }
+    std::vector<unsigned char> exr;
+    put32LE(exr, 20000630);     // magic
+    put32LE(exr, 2);            // version 2, single part scanline
+
+    std::vector<unsigned char> channels;
+    for (const char* name : { "B", "G", "R" }) {
+        putString(channels, name);
+        put32LE(channels, 2);   // FLOAT
+        put32LE(channels, 0);   // pLinear and reserved
+        put32LE(channels, 1);   // x sampling
+        put32LE(channels, 1);   // y sampling
+    }
+    channels.push_back(0);
+    std::vector<unsigned char> window;
+    put32LE(window, 0);
+    put32LE(window, 0);
+    put32LE(window, (uint32_t)(width - 1));
+    put32LE(window, (uint32_t)(height - 1));
+    std::vector<unsigned char> one, center;
+    putFloatLE(one, 1.0f);
+    putFloatLE(center, 0.0f);
+    putFloatLE(center, 0.0f);
+
+    putAttribute(exr, "channels", "chlist", channels);
+    putAttribute(exr, "compression", "compression", { 0 });
+    putAttribute(exr, "dataWindow", "box2i", window);
+    putAttribute(exr, "displayWindow", "box2i", window);
+    putAttribute(exr, "lineOrder", "lineOrder", { 0 });
+    putAttribute(exr, "pixelAspectRatio", "float", one);
+    putAttribute(exr, "screenWindowCenter", "v2f", center);
+    putAttribute(exr, "screenWindowWidth", "float", one);
+    exr.push_back(0);
+
+    size_t lineBytes = (size_t)width * 3 * sizeof(float);
+    uint64_t first = exr.size() + (uint64_t)height * 8;
+    for (int y = 0; y < height; y++) {
+        put64LE(exr, first + (uint64_t)y * (8 + lineBytes));
+    }
+    for (int y = 0; y < height; y++) {
+        put32LE(exr, (uint32_t)y);
+        put32LE(exr, (uint32_t)lineBytes);
+        for (int channel = 2; channel >= 0; channel--) {
+            for (int x = 0; x < width; x++) {
+                putFloatLE(exr, rgb[((size_t)y * width + x) * 3 + channel]);
+            }
+        }
+    }
+    return writeFile(fileName, exr);
+}
@@ -0,0 +1,361 @@
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "shaders/noise.h"
+#include "shaders/parallel.h"
+
+// Cloud noise volume
+//
+// 1. Perlin fBm:
+//    gradient noise on a lattice that wraps every (perlinFrequency * 2^o) cells,
+//    octaves weighted by 0.5^o.
+//
+// 2. Worley fBm:
+//    1 - F1, the distance to the closest feature point of the 27 neighbouring cells,
+//    on a grid of (worleyCells * 2^o) cells that wraps around the volume.
+//
+// 3. Perlin-worley:
+//    remap(perlin, worley - 1, 1, 0, 1), so worley carves billowy cells out of the perlin base.
+//
+// Slices are distributed over threads, and the worley distances of a voxel row are
+// evaluated four voxels at a time, in fixed size loops the compiler vectorizes.
+//
+// Blue noise:
+//    void-and-cluster (Ulichney 1993) with a gaussian energy filter of sigma 1.5 on the torus.
+
+namespace {
+
+inline unsigned int hash(int x, int y, int z, unsigned int seed) {
+    unsigned int h = seed ^ ((unsigned int)x * 0x8da6b343u) ^ ((unsigned int)y * 0xd8163841u) ^ ((unsigned int)z * 0xcb1ab31fu);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+inline int wrap(int v, int period) {
+    return ((v % period) + period) % period;
+}
+
+inline float fade(float t) {
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+inline float lerp(float a, float b, float t) {
+    return a + (b - a) * t;
+}
+
+// dot product with one of the 12 cube edge gradients
+inline float gradient(unsigned int h, float x, float y, float z) {
+    switch (h % 12) {
+        case 0:  return  x + y;
+        case 1:  return -x + y;
+        case 2:  return  x - y;
+        case 3:  return -x - y;
+        case 4:  return  x + z;
+        case 5:  return -x + z;
+        case 6:  return  x - z;
+        case 7:  return -x - z;
+        case 8:  return  y + z;
+        case 9:  return -y + z;
+        case 10: return  y - z;
+        default: return -y - z;
+    }
+}
+
+// tileable perlin noise in about [-1, 1], position in lattice units
+float perlin(float x, float y, float z, int period, unsigned int seed) {
+    int ix = (int)std::floor(x);
+    int iy = (int)std::floor(y);
+    int iz = (int)std::floor(z);
+    float fx = x - ix;
+    float fy = y - iy;
+    float fz = z - iz;
+
+    int x0 = wrap(ix, period), x1 = wrap(ix + 1, period);
+    int y0 = wrap(iy, period), y1 = wrap(iy + 1, period);
+    int z0 = wrap(iz, period), z1 = wrap(iz + 1, period);
+
+    float u = fade(fx);
+    float v = fade(fy);
+    float w = fade(fz);
+
+    float n000 = gradient(hash(x0, y0, z0, seed), fx,        fy,        fz);
+    float n100 = gradient(hash(x1, y0, z0, seed), fx - 1.0f, fy,        fz);
+    float n010 = gradient(hash(x0, y1, z0, seed), fx,        fy - 1.0f, fz);
+    float n110 = gradient(hash(x1, y1, z0, seed), fx - 1.0f, fy - 1.0f, fz);
+    float n001 = gradient(hash(x0, y0, z1, seed), fx,        fy,        fz - 1.0f);
+    float n101 = gradient(hash(x1, y0, z1, seed), fx - 1.0f, fy,        fz - 1.0f);
+    float n011 = gradient(hash(x0, y1, z1, seed), fx,        fy - 1.0f, fz - 1.0f);
+    float n111 = gradient(hash(x1, y1, z1, seed), fx - 1.0f, fy - 1.0f, fz - 1.0f);
+
+    return lerp(lerp(lerp(n000, n100, u), lerp(n010, n110, u), v),
+                lerp(lerp(n001, n101, u), lerp(n011, n111, u), v), w);
+}
+
+// Worley F1 distance (in cell units) for every voxel of row (y, z), written to 'out'
+void worleyRow(int res, int cells, int y, int z, unsigned int seed, float* out) {
+    float scale = (float)cells / res;
+    float py = (y + 0.5f) * scale;
+    float pz = (z + 0.5f) * scale;
+    int cy = (int)std::floor(py);
+    int cz = (int)std::floor(pz);
+
+    int start = 0;
+    for (int cx = 0; cx < cells; cx++) {
+        // voxels whose centers fall into cell cx
+        int end = start;
+        while (end < res && (int)std::floor((end + 0.5f) * scale) == cx) end++;
+        if (end == start) continue;
+
+        // feature points of the 27 neighbouring cells, with the y/z distance folded in
+        float featureX[27];
+        float distYZ[27];
+        int n = 0;
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int nx = cx + dx, ny = cy + dy, nz = cz + dz;
+                    unsigned int h = hash(wrap(nx, cells), wrap(ny, cells), wrap(nz, cells), seed);
+                    float ox = (h & 0x3ff) / 1023.0f;
+                    float oy = ((h >> 10) & 0x3ff) / 1023.0f;
+                    float oz = ((h >> 20) & 0x3ff) / 1023.0f;
+                    float fy = ny + oy - py;
+                    float fz = nz + oz - pz;
+                    featureX[n] = nx + ox;
+                    distYZ[n] = fy * fy + fz * fz;
+                    n++;
+                }
+            }
+        }
+
+        for (int x = start; x < end; x += 4) {
+            float px[4], best[4];
+            for (int lane = 0; lane < 4; lane++) {
+                px[lane] = (x + lane + 0.5f) * scale;
+                best[lane] = 1e9f;
+            }
+            for (int i = 0; i < 27; i++) {
+                for (int lane = 0; lane < 4; lane++) {
+                    float d = px[lane] - featureX[i];
+                    best[lane] = std::min(best[lane], d * d + distYZ[i]);
+                }
+            }
+            for (int lane = 0; lane < 4 && x + lane < end; lane++) {
+                out[x + lane] = std::sqrt(best[lane]);
+            }
+        }
+        start = end;
+    }
+}
+
+}
+
+ppm* generateCloudNoise(const CloudNoiseParams& params) {
+    int res = std::max(params.resolution, 4);
+    int octaves = std::max(params.octaves, 1);
+    ppm* image = new ppm(res, res * res);
+    char* pixels = image->getPixels();
+
+    // normalize the fBm sums back into [0, 1]
+    float weightSum = 0.0f;
+    for (int o = 0; o < octaves; o++) {
+        weightSum += std::pow(0.5f, (float)o);
+    }
+
+    // raw perlin-worley values, stretched to [0, 255] once the whole volume is known
+    std::vector<float> volume((size_t)res * res * res);
+    parallelEach(res, [&](int z) {
+        std::vector<float> perlinSum(res), worleySum(res), distances(res);
+        for (int y = 0; y < res; y++) {
+            std::fill(perlinSum.begin(), perlinSum.end(), 0.0f);
+            std::fill(worleySum.begin(), worleySum.end(), 0.0f);
+            for (int o = 0; o < octaves; o++) {
+                float weight = std::pow(0.5f, (float)o) / weightSum;
+                unsigned int octaveSeed = params.seed + 1013u * o;
+
+                int period = params.perlinFrequency << o;
+                float perlinScale = (float)period / res;
+                for (int x = 0; x < res; x++) {
+                    perlinSum[x] += weight * perlin((x + 0.5f) * perlinScale, (y + 0.5f) * perlinScale, (z + 0.5f) * perlinScale, period, octaveSeed);
+                }
+
+                worleyRow(res, params.worleyCells << o, y, z, octaveSeed, distances.data());
+                for (int x = 0; x < res; x++) {
+                    worleySum[x] += weight * std::max(1.0f - distances[x], 0.0f);
+                }
+            }
+
+            float* dst = &volume[((size_t)z * res + y) * res];
+            for (int x = 0; x < res; x++) {
+                float p = perlinSum[x] * 0.5f + 0.5f;
+                float w = worleySum[x];
+                // remap(p, w - 1, 1, 0, 1)
+                dst[x] = (p - (w - 1.0f)) / (2.0f - w);
+            }
+        }
+    });
+
+    // normalize the noise to [0, 255]
+    auto range = std::minmax_element(volume.begin(), volume.end());
+    float minValue = *range.first;
+    float scale = 255.0f / std::max(*range.second - minValue, 1e-6f);
+    for (size_t i = 0; i < volume.size(); i++) {
+        char c = (char)(unsigned char)((volume[i] - minValue) * scale + 0.5f);
+        pixels[3 * i] = pixels[3 * i + 1] = pixels[3 * i + 2] = c;
+    }
+    return image;
+}
+
+std::vector<unsigned char> buildNoiseMaxGrid(ppm* image, int size, int cells, int frequency) {
+    const unsigned char* pixels = (const unsigned char*)image->getPixels();
+    int tiles = size > 0 ? image->getWidth() / size : 0;
+    if (!pixels || tiles == 0 || image->getHeight() / size * tiles < size || cells < 1) {
+        return std::vector<unsigned char>();
+    }
+
+    // voxel range [first[i], last[i]] touched by filtered lookups inside cell i, along any axis
+    std::vector<int> first(cells), last(cells);
+    for (int i = 0; i < cells; i++) {
+        first[i] = (int)((long long)i * size * frequency / cells) - 1;
+        last[i] = (int)(((long long)(i + 1) * size * frequency + cells - 1) / cells);
+        if (last[i] - first[i] >= size) {
+            first[i] = 0;
+            last[i] = size - 1;
+        }
+    }
+
+    // separable max, x then y then z, each pass shrinks one axis from size to cells
+    std::vector<unsigned char> rows((size_t)size * size * cells);
+    for (int z = 0; z < size; z++) {
+        int tileX = (z % tiles) * size;
+        int tileY = (z / tiles) * size;
+        for (int y = 0; y < size; y++) {
+            const unsigned char* src = pixels + ((size_t)(tileY + y) * image->getWidth() + tileX) * 3;
+            for (int i = 0; i < cells; i++) {
+                unsigned char m = 0;
+                for (int x = first[i]; x <= last[i]; x++) {
+                    m = std::max(m, src[wrap(x, size) * 3]);
+                }
+                rows[((size_t)z * size + y) * cells + i] = m;
+            }
+        }
+    }
+    std::vector<unsigned char> slabs((size_t)size * cells * cells);
+    for (int z = 0; z < size; z++) {
+        for (int j = 0; j < cells; j++) {
+            for (int i = 0; i < cells; i++) {
+                unsigned char m = 0;
+                for (int y = first[j]; y <= last[j]; y++) {
+                    m = std::max(m, rows[((size_t)z * size + wrap(y, size)) * cells + i]);
+                }
+                slabs[((size_t)z * cells + j) * cells + i] = m;
+            }
+        }
+    }
+    std::vector<unsigned char> grid((size_t)cells * cells * cells);
+    for (int k = 0; k < cells; k++) {
+        for (int j = 0; j < cells; j++) {
+            for (int i = 0; i < cells; i++) {
+                unsigned char m = 0;
+                for (int z = first[k]; z <= last[k]; z++) {
+                    m = std::max(m, slabs[((size_t)wrap(z, size) * cells + j) * cells + i]);
+                }
+                grid[((size_t)k * cells + j) * cells + i] = m;
+            }
+        }
+    }
+    return grid;
+}
+
+std::vector<unsigned char> generateBlueNoise(int size, unsigned int seed) {
+    size = std::max(size, 4);
+    int count = size * size;
+
+    // toroidal gaussian, energy[i] is the filtered sum of the set pixels around i
+    const float sigma = 1.5f;
+    std::vector<float> kernel(count);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            int dx = std::min(x, size - x);
+            int dy = std::min(y, size - y);
+            kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+        }
+    }
+    std::vector<char> pattern(count, 0);
+    std::vector<float> energy(count, 0.0f);
+    auto toggle = [&](int index, bool on) {
+        pattern[index] = on;
+        int px = index % size, py = index / size;
+        float sign = on ? 1.0f : -1.0f;
+        for (int y = 0; y < size; y++) {
+            const float* row = &kernel[wrap(y - py, size) * size];
+            float* dst = &energy[y * size];
+            for (int x = 0; x < size; x++) {
+                dst[x] += sign * row[wrap(x - px, size)];
+            }
+        }
+    };
+    // tightest cluster is the set pixel with the most energy, largest void the empty one with the least
+    auto tightestCluster = [&]() {
+        int best = -1;
+        for (int i = 0; i < count; i++) {
+            if (pattern[i] && (best < 0 || energy[i] > energy[best])) best = i;
+        }
+        return best;
+    };
+    auto largestVoid = [&]() {
+        int best = -1;
+        for (int i = 0; i < count; i++) {
+            if (!pattern[i] && (best < 0 || energy[i] < energy[best])) best = i;
+        }
+        return best;
+    };
+
+    // initial pattern: a tenth of the pixels, then move clusters into voids until it settles
+    int initial = std::max(count / 10, 1);
+    for (int placed = 0, attempt = 0; placed < initial; attempt++) {
+        int index = hash(attempt, 0, 0, seed) % count;
+        if (!pattern[index]) {
+            toggle(index, true);
+            placed++;
+        }
+    }
+    while (true) {
+        int cluster = tightestCluster();
+        toggle(cluster, false);
+        int hole = largestVoid();
+        if (hole == cluster) {
+            toggle(cluster, true);
+            break;
+        }
+        toggle(hole, true);
+    }
+    std::vector<char> initialPattern = pattern;
+    std::vector<float> initialEnergy = energy;
+
+    std::vector<int> rank(count, 0);
+    // phase 1: rank the initial pixels by removing clusters
+    for (int ones = initial; ones > 0; ones--) {
+        int cluster = tightestCluster();
+        toggle(cluster, false);
+        rank[cluster] = ones - 1;
+    }
+    // phase 2 and 3: fill voids until every pixel is set. The tightest cluster of empty pixels
+    // is the largest void of set ones, so the same search serves both halves.
+    pattern = initialPattern;
+    energy = initialEnergy;
+    for (int ones = initial; ones < count; ones++) {
+        int hole = largestVoid();
+        toggle(hole, true);
+        rank[hole] = ones;
+    }
+
+    std::vector<unsigned char> noise(count);
+    for (int i = 0; i < count; i++) {
+        noise[i] = (unsigned char)((long long)rank[i] * 256 / count);
+    }
+    return noise;
+}
@@ -3,20 +3,41 @@
 #include <cmath>
 #include <random>
 #include <iomanip>
+#include <algorithm>
+#include "shaders/ocean.h"
+#include "shaders/parallel.h"
 
-const int N = 32;
-const float L = 64.0f;
 const float GRAVITY = 9.81f;
-const float WAVE_AMP = 0.0002f;
-const float WIND_SPEED = 32.0f;
-const float DAMPING = 0.001f;
+// Texels each thread of a per frame pass gets at least. A pass over a 64 x 64 grid takes about
+// as long as starting the threads would, so grids up to that size are updated on one thread.
+const int MIN_TEXELS_PER_THREAD = 8192;
 
-struct WaveData {
-    float dirX, dirZ;
-    float omega;
-    float amplitude;
-    float phaseOffset;
-};
+namespace {
+
+// P(k) for a wave vector (kx, kz), 0 for k = 0, reverse waves and negligible energy
+float phillips(const OceanParams& params, float windX, float windZ, float kx, float kz) {
+    const float L_wind = (params.windSpeed * params.windSpeed) / GRAVITY;
+    const float l2 = L_wind * L_wind * params.damping * params.damping;
+    float k_length2 = kx * kx + kz * kz;
+    if (k_length2 < 1e-12f) return 0.0f;
+
+    float k_length = std::sqrt(k_length2);
+    float k_dot_wind = (kx * windX + kz * windZ) / k_length;
+    if (k_dot_wind < 0) return 0.0f;
+
+    float k_length4 = k_length2 * k_length2;
+    float value = params.waveAmp * std::exp(-1.0f / (k_length2 * L_wind * L_wind)) / k_length4;
+    value *= std::pow(k_dot_wind, 6) * std::exp(-k_length2 * l2);
+    return value < 1e-8f ? 0.0f : value;
+}
+
+void normalizeWind(const OceanParams& params, float& windX, float& windZ) {
+    float windLength = std::sqrt(params.windDirX * params.windDirX + params.windDirZ * params.windDirZ);
+    windX = windLength > 0.0f ? params.windDirX / windLength : 1.0f;
+    windZ = windLength > 0.0f ? params.windDirZ / windLength : 0.0f;
+}
+
+}
 
 // 1. Wave Vector k:
 //    k = (kx, kz), computed as:
@@ -30,44 +51,36 @@ struct WaveData {
 //    - (k · w) < 0: Ignore reverse waves.
 //    - Small P(k): Skip negligible energy.
 
-std::vector<WaveData> generatePhillipsSpectrum() {
+std::vector<WaveData> generatePhillipsSpectrum(const OceanParams& params) {
     std::vector<WaveData> waves;
-    std::default_random_engine generator(42);
+    std::default_random_engine generator(params.seed);
     std::uniform_real_distribution<float> phaseDist(0.0f, 2.0f * M_PI);
 
-    const float L_wind = (WIND_SPEED * WIND_SPEED) / GRAVITY;
-    const float l2 = L_wind * L_wind * DAMPING * DAMPING;
+    const int N = params.N;
+    const float L = params.L;
 
-    for (int m_prime = 0; m_prime < N / 2; ++m_prime) {
+    float windX, windZ;
+    normalizeWind(params, windX, windZ);
+
+    int rows = params.halfPlane ? N / 2 : N;
+    for (int m_prime = 0; m_prime < rows; ++m_prime) {
         for (int n_prime = 0; n_prime < N; ++n_prime) {
 
             float kx = M_PI * (2 * n_prime - N) / L;
             float kz = M_PI * (2 * m_prime - N) / L;
-            float k_length = std::sqrt(kx * kx + kz * kz);
-
-            if (k_length < 1e-6) continue;
+            float value = phillips(params, windX, windZ, kx, kz);
+            if (value == 0.0f) continue;
 
+            float k_length = std::sqrt(kx * kx + kz * kz);
             float k_unitX = kx / k_length;
             float k_unitZ = kz / k_length;
-            float k_dot_wind = k_unitX * 1.0f + k_unitZ * 0.0f;  // wind direction (1, 0)
-
-            if (k_dot_wind < 0) continue;
-
-            // Phillips Spectrum
-            float k_length2 = k_length * k_length;
-            float k_length4 = k_length2 * k_length2;
-
-            float phillips = WAVE_AMP * std::exp(-1.0f / (k_length2 * L_wind * L_wind)) / k_length4;
-            phillips *= std::pow(k_dot_wind, 6) * std::exp(-k_length2 * l2);
-
-            if (phillips < 1e-8) continue;
 
             // Save data
             WaveData wave;
             wave.dirX = k_unitX;
             wave.dirZ = k_unitZ;
             wave.omega = std::sqrt(GRAVITY * k_length);
-            wave.amplitude = std::sqrt(phillips);
+            wave.amplitude = std::sqrt(value);
             wave.phaseOffset = phaseDist(generator);
 
             waves.push_back(wave);
@@ -75,3 +88,281 @@ std::vector<WaveData> generatePhillipsSpectrum() {
     }
     return waves;
 }
+
+// H = sum A * sin(k . x - wt + phi), with k = dir * omega as in the shader
+float evaluateWaveHeight(const std::vector<WaveData>& waves, float x, float z, float t) {
+    float height = 0.0f;
+    for (const WaveData& w : waves) {
+        float phase = (w.dirX * x + w.dirZ * z) * w.omega - w.omega * t + w.phaseOffset;
+        height += w.amplitude * std::sin(phase);
+    }
+    return height;
+}
+
+// The normal uses the analytic gradient dH/dx = sum A * cos(phase) * dirX * omega
+void bakeWaveMaps(const std::vector<WaveData>& waves, int size, float worldSize, float t,
+                  std::vector<float>& heights, std::vector<float>& normals) {
+    heights.resize((size_t)size * size);
+    normals.resize((size_t)size * size * 3);
+
+    auto bakeRows = [&](int firstRow, int lastRow) {
+        for (int j = firstRow; j < lastRow; j++) {
+            float z = (j + 0.5f) * worldSize / size;
+            for (int i = 0; i < size; i++) {
+                float x = (i + 0.5f) * worldSize / size;
+                float h = 0.0f, dhdx = 0.0f, dhdz = 0.0f;
+                for (const WaveData& w : waves) {
+                    float phase = (w.dirX * x + w.dirZ * z) * w.omega - w.omega * t + w.phaseOffset;
+                    float c = w.amplitude * w.omega * std::cos(phase);
+                    h += w.amplitude * std::sin(phase);
+                    dhdx += c * w.dirX;
+                    dhdz += c * w.dirZ;
+                }
+                size_t index = (size_t)j * size + i;
+                float invLength = 1.0f / std::sqrt(dhdx * dhdx + 1.0f + dhdz * dhdz);
+                heights[index] = h;
+                normals[3 * index] = -dhdx * invLength;
+                normals[3 * index + 1] = invLength;
+                normals[3 * index + 2] = -dhdz * invLength;
+            }
+        }
+    };
+
+    parallelFor(size, bakeRows);
+}
+
+// Tessendorf ocean
+//
+// 1. h0(k) = 1/sqrt(2) * (xi_r + i xi_i) * sqrt(P(k)), xi gaussian
+//
+// 2. h(k, t) = h0(k) exp(i w t) + conj(h0(-k)) exp(-i w t), hermitian so its transform is real
+//
+// 3. from the same spectrum:
+//    slope     i k h(k, t)
+//    choppy    -i k / |k| h(k, t)
+//
+// Two real fields are packed into one complex transform (a + i b), so five fields take three FFTs.
+// The grid is centered, k = 2 pi (n - N/2) / L, which multiplies the output by (-1)^(x + z).
+
+Ocean::Ocean(const OceanParams& params) : L(params.L), choppiness(params.choppiness) {
+    // round N down to a power of two
+    logN = 0;
+    while ((2 << logN) <= std::max(params.N, 2)) logN++;
+    N = 1 << logN;
+    rowsPerThread = std::max(1, MIN_TEXELS_PER_THREAD / N);
+
+    float windX, windZ;
+    normalizeWind(params, windX, windZ);
+
+    std::default_random_engine generator(params.seed);
+    std::normal_distribution<float> gaussian(0.0f, 1.0f);
+
+    size_t count = (size_t)N * N;
+    h0.resize(count);
+    h0MinusConj.resize(count);
+    omega.resize(count);
+    kX.resize(count);
+    kZ.resize(count);
+    for (int m = 0; m < N; m++) {
+        for (int n = 0; n < N; n++) {
+            size_t index = (size_t)m * N + n;
+            float kx = 2.0f * M_PI * (n - N / 2) / L;
+            float kz = 2.0f * M_PI * (m - N / 2) / L;
+            float xiR = gaussian(generator);
+            float xiI = gaussian(generator);
+            // the nyquist row and column have no -k partner, leaving them out keeps every field real
+            bool nyquist = n == 0 || m == 0;
+            h0[index] = nyquist ? Complex(0.0f) : Complex(xiR, xiI) * std::sqrt(phillips(params, windX, windZ, kx, kz) * 0.5f);
+            omega[index] = std::sqrt(GRAVITY * std::sqrt(kx * kx + kz * kz));
+            kX[index] = kx;
+            kZ[index] = kz;
+        }
+    }
+    for (int m = 0; m < N; m++) {
+        for (int n = 0; n < N; n++) {
+            // -k lives at (N - n, N - m)
+            size_t minus = (size_t)((N - m) % N) * N + (N - n) % N;
+            h0MinusConj[(size_t)m * N + n] = std::conj(h0[minus]);
+        }
+    }
+
+    twiddles.resize(N / 2);
+    for (int j = 0; j < N / 2; j++) {
+        twiddles[j] = std::polar(1.0f, (float)(2.0 * M_PI * j / N));
+    }
+    bitReverse.resize(N);
+    for (int i = 0; i < N; i++) {
+        int reversed = 0;
+        for (int b = 0; b < logN; b++) {
+            reversed |= ((i >> b) & 1) << (logN - 1 - b);
+        }
+        bitReverse[i] = reversed;
+    }
+
+    heightSlopeX.resize(count);
+    displaceXZ.resize(count);
+    slopeZ.resize(count);
+    displacement.resize(count * 3);
+    slopes.resize(count * 2);
+    heights.resize(count);
+    normals.resize(count * 3);
+    for (int level = 0; level <= logN; level++) {
+        heightBounds.push_back(std::vector<float>((count >> (2 * level)) * 2));
+    }
+}
+
+void Ocean::update(float t) {
+    const Complex I(0.0f, 1.0f);
+
+    parallelFor(N, [&](int firstRow, int lastRow) {
+        for (size_t index = (size_t)firstRow * N; index < (size_t)lastRow * N; index++) {
+            float c = std::cos(omega[index] * t);
+            float s = std::sin(omega[index] * t);
+            Complex h = h0[index] * Complex(c, s) + h0MinusConj[index] * Complex(c, -s);
+
+            float kx = kX[index];
+            float kz = kZ[index];
+            float k_length = std::sqrt(kx * kx + kz * kz);
+            Complex choppyX = k_length > 0.0f ? -I * (kx / k_length) * h : Complex(0.0f);
+            Complex choppyZ = k_length > 0.0f ? -I * (kz / k_length) * h : Complex(0.0f);
+
+            heightSlopeX[index] = h + I * (I * kx * h);
+            displaceXZ[index] = choppyX + I * choppyZ;
+            slopeZ[index] = I * kz * h;
+        }
+    }, rowsPerThread);
+
+    std::vector<Complex>* spectra[] = { &heightSlopeX, &displaceXZ, &slopeZ };
+    inverseFFT(spectra, 3);
+
+    parallelFor(N, [&](int firstRow, int lastRow) {
+        for (int z = firstRow; z < lastRow; z++) {
+            for (int x = 0; x < N; x++) {
+                size_t index = (size_t)z * N + x;
+                float sign = ((x + z) & 1) ? -1.0f : 1.0f;
+                float h = sign * heightSlopeX[index].real();
+                float dhdx = sign * heightSlopeX[index].imag();
+                float dhdz = sign * slopeZ[index].real();
+                displacement[3 * index] = choppiness * sign * displaceXZ[index].real();
+                displacement[3 * index + 1] = h;
+                displacement[3 * index + 2] = choppiness * sign * displaceXZ[index].imag();
+                slopes[2 * index] = dhdx;
+                slopes[2 * index + 1] = dhdz;
+            }
+        }
+    }, rowsPerThread);
+
+    resolveSurface();
+    buildHeightBounds();
+}
+
+// The surface above grid point x was carried there from x0 = x - D(x0).
+// Two fixed point steps find x0, height and slopes are then interpolated there.
+void Ocean::resolveSurface() {
+    const float toGrid = N / L;
+
+    // bilinear lookup of 'channels' floats per texel at grid position (u, v), wrapping
+    auto sample = [&](const std::vector<float>& data, int channels, float u, float v, float* out) {
+        float fu = std::floor(u), fv = std::floor(v);
+        float su = u - fu, sv = v - fv;
+        int x0 = ((int)fu % N + N) % N, z0 = ((int)fv % N + N) % N;
+        int x1 = (x0 + 1) % N, z1 = (z0 + 1) % N;
+        for (int c = 0; c < channels; c++) {
+            float a = data[((size_t)z0 * N + x0) * channels + c];
+            float b = data[((size_t)z0 * N + x1) * channels + c];
+            float d = data[((size_t)z1 * N + x0) * channels + c];
+            float e = data[((size_t)z1 * N + x1) * channels + c];
+            out[c] = (a + (b - a) * su) + ((d + (e - d) * su) - (a + (b - a) * su)) * sv;
+        }
+    };
+
+    parallelFor(N, [&](int firstRow, int lastRow) {
+        float d[3], slope[2];
+        for (int z = firstRow; z < lastRow; z++) {
+            for (int x = 0; x < N; x++) {
+                size_t index = (size_t)z * N + x;
+                float u = x - displacement[3 * index] * toGrid;
+                float v = z - displacement[3 * index + 2] * toGrid;
+                sample(displacement, 3, u, v, d);
+                u = x - d[0] * toGrid;
+                v = z - d[2] * toGrid;
+                sample(displacement, 3, u, v, d);
+                sample(slopes, 2, u, v, slope);
+
+                float invLength = 1.0f / std::sqrt(slope[0] * slope[0] + 1.0f + slope[1] * slope[1]);
+                heights[index] = d[1];
+                normals[3 * index] = -slope[0] * invLength;
+                normals[3 * index + 1] = invLength;
+                normals[3 * index + 2] = -slope[1] * invLength;
+            }
+        }
+    }, rowsPerThread);
+}
+
+// Level 0 bounds the bilinear patch between four neighbouring grid points, every further level
+// merges 2 x 2 cells, up to one cell for the whole patch.
+void Ocean::buildHeightBounds() {
+    std::vector<float>& base = heightBounds[0];
+    for (int z = 0; z < N; z++) {
+        for (int x = 0; x < N; x++) {
+            int x1 = (x + 1) % N, z1 = (z + 1) % N;
+            float a = heights[(size_t)z * N + x], b = heights[(size_t)z * N + x1];
+            float c = heights[(size_t)z1 * N + x], d = heights[(size_t)z1 * N + x1];
+            base[2 * ((size_t)z * N + x)] = std::min(std::min(a, b), std::min(c, d));
+            base[2 * ((size_t)z * N + x) + 1] = std::max(std::max(a, b), std::max(c, d));
+        }
+    }
+    for (int level = 1; level <= logN; level++) {
+        const std::vector<float>& fine = heightBounds[level - 1];
+        std::vector<float>& coarse = heightBounds[level];
+        int fineSize = N >> (level - 1);
+        int size = N >> level;
+        for (int z = 0; z < size; z++) {
+            for (int x = 0; x < size; x++) {
+                const float* c00 = &fine[2 * ((size_t)(2 * z) * fineSize + 2 * x)];
+                const float* c01 = &fine[2 * ((size_t)(2 * z + 1) * fineSize + 2 * x)];
+                coarse[2 * ((size_t)z * size + x)] = std::min(std::min(c00[0], c00[2]), std::min(c01[0], c01[2]));
+                coarse[2 * ((size_t)z * size + x) + 1] = std::max(std::max(c00[1], c00[3]), std::max(c01[1], c01[3]));
+            }
+        }
+    }
+}
+
+// In place 2D inverse transforms (no 1/N^2 scale) of count spectra: rows first, then columns
+void Ocean::inverseFFT(std::vector<Complex>* spectra[], int count) {
+    auto transform = [&](Complex* line) {
+        for (int i = 0; i < N; i++) {
+            if (i < bitReverse[i]) std::swap(line[i], line[bitReverse[i]]);
+        }
+        for (int length = 2, step = N / 2; length <= N; length <<= 1, step >>= 1) {
+            int half = length / 2;
+            for (int start = 0; start < N; start += length) {
+                for (int j = 0; j < half; j++) {
+                    Complex odd = line[start + j + half] * twiddles[j * step];
+                    line[start + j + half] = line[start + j] - odd;
+                    line[start + j] += odd;
+                }
+            }
+        }
+    };
+
+    parallelFor(N, [&](int first, int last) {
+        for (int s = 0; s < count; s++) {
+            Complex* data = spectra[s]->data();
+            for (int row = first; row < last; row++) {
+                transform(data + (size_t)row * N);
+            }
+        }
+    }, rowsPerThread);
+    parallelFor(N, [&](int first, int last) {
+        std::vector<Complex> column(N);
+        for (int s = 0; s < count; s++) {
+            Complex* data = spectra[s]->data();
+            for (int col = first; col < last; col++) {
+                for (int row = 0; row < N; row++) column[row] = data[(size_t)row * N + col];
+                transform(column.data());
+                for (int row = 0; row < N; row++) data[(size_t)row * N + col] = column[row];
+            }
+        }
+    }, rowsPerThread);
+}
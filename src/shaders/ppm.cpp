@@ -10,9 +10,99 @@
 
 #include <FL/gl.h>
 #include <iostream>
-#include <string>
 #include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <climits>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "shaders/ppm.h"
+#include "shaders/parallel.h"
+
+namespace {
+
+// Minimum number of body bytes handed to one parsing thread
+const size_t MIN_CHUNK_BYTES = 256 * 1024;
+
+inline bool isSpace(char c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+inline bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+// Skip whitespace and '#' comments (which run to the end of the line)
+size_t skipSpaceAndComments(const char* data, size_t pos, size_t end) {
+	while (pos < end) {
+		if (isSpace(data[pos])) {
+			pos++;
+		}
+		else if (data[pos] == '#') {
+			while (pos < end && data[pos] != '\n') pos++;
+		}
+		else {
+			break;
+		}
+	}
+	return pos;
+}
+
+// Read one unsigned header integer, comments are allowed in front of it
+bool readHeaderInt(const char* data, size_t& pos, size_t end, int& value) {
+	pos = skipSpaceAndComments(data, pos, end);
+	if (pos >= end || !isDigit(data[pos])) {
+		return false;
+	}
+	value = 0;
+	while (pos < end && isDigit(data[pos])) {
+		value = value * 10 + (data[pos] - '0');
+		pos++;
+	}
+	return true;
+}
+
+/*	Parse every integer in data[begin, end) into 'out', scaling from [0, maxValue] to [0, 255].
+	The range must start and end on a token boundary. */
+void parseRange(const char* data, size_t begin, size_t end, int maxValue, std::vector<char>& out) {
+	// a P3 value takes at least two bytes ("0 ")
+	out.resize((end - begin) / 2 + 1);
+	char* dst = out.data();
+	const char* p = data + begin;
+	const char* last = data + end;
+	while (p < last) {
+		char c = *p;
+		if (isDigit(c)) {
+			int value = c - '0';
+			p++;
+			while (p < last && isDigit(*p)) {
+				value = value * 10 + (*p - '0');
+				p++;
+			}
+			if (maxValue != 255) {
+				value = value * 255 / maxValue;
+			}
+			*dst++ = (char)value;
+		}
+		else if (c == '#') {
+			const char* nl = (const char*)memchr(p, '\n', last - p);
+			p = nl ? nl : last;
+		}
+		else {
+			// whitespace, or anything else that is not part of a number
+			p++;
+		}
+	}
+	out.resize(dst - out.data());
+}
+}
 
 /*	===============================================
 Desc:	Default constructor for a ppm
@@ -23,88 +113,147 @@ Postcondition: The array 'color' is allocated memory according to the image dime
 =============================================== */ 
 ppm::ppm(std::string _fileName){
 	textureID = -1;
+	volumeSize = 0;
+	volumeDepth = 0;
+	slicesUploaded = 0;
+	width = 0;
+	height = 0;
+	color = NULL;
   /* Algorithm
-      Step 1: Parse header of PPM
-      Step 2: Read in colors into array
+      Step 1: Map or read the file into memory
+      Step 2: Parse header of PPM (comments may appear between any two tokens)
       Step 3: Allocate memory for width and height dimensions
+      Step 4: Split the pixel data into line aligned ranges and parse them in parallel
   */
 
-
-  // Open an input file stream for reading a file
-  std::ifstream ppmFile(_fileName.c_str());
-  // If our file successfully opens, begin to process it.
-  if (ppmFile.is_open()) {
-	  // line will store one line of input
-	  std::string line;
-	  // Our loop invariant is to continue reading input until
-	  // we reach the end of the file and it reads in a NULL character
-	  std::cout << "Reading in ppm file: " << _fileName << std::endl;
-	  // Our delimeter pointer which is used to store a single token in a given
-	  // string split up by some delimeter(s) specified in the strtok function
-	  char* delimeter_pointer;
-	  int iteration = 0;
-	  int pos = 0;
-	  while (getline(ppmFile, line)) {
-		  char* copy = new char[line.length() + 1];
-		  strcpy(copy, line.c_str());
-		  delimeter_pointer = strtok(copy, " ");
-
-		  if (copy[0] == '#') {
-			  continue;
-		  }
-
-		  // Read in the magic number
-		  if (iteration == 0) {
-			  magicNumber = delimeter_pointer;
-			  std::cout << "Magic Number: " << magicNumber << std::endl;
-			  if (magicNumber.compare("P3") != 0) {
-				  std::cout <<  "Incorrect image file format.Cannot load texutre" << std::endl;
-				  break;
-			  }
-		  }
-		  // Read in dimensions
-		  else if (iteration == 1) {
-			  width = atoi(delimeter_pointer);
-			  std::cout << "width: " << width << " ";
-			  delimeter_pointer = strtok(NULL, " ");
-			  height = atoi(delimeter_pointer);
-			  std::cout << "height: " << height << std::endl;
-			  // Allocate memory for the color array
-			  if (width > 0 && height > 0) {
-				  color = new char[width*height * 3];
-				  if (color == NULL) {
-					  std::cout << "Unable to allocate memory for ppm" << std::endl;
-					  break;
-				  }
-			  }
-			  else {
-				  std::cout << "PPM not parsed correctly, width and height dimensions are 0" << std::endl;
-				  break;
-			  }
-		  }
-		  else if (iteration == 2) {
-			  std::cout << "color range: 0-" << delimeter_pointer << std::endl;
-
-			  int num = width * height * 3;
-			  for (int i = 0; i < num; i++) {
-				  int value;
-				  ppmFile >> value;
-                  //std::cout << i << ": " << value << std::endl;
-				  color[i] = value;
-			  }
-		  }
-		  delete [] copy;
-		  iteration++;
-	  }
-	  ppmFile.close();
+  // map the file where the platform has mmap, else read it into memory
+  std::vector<char> fileBuffer;
+  const char* data = NULL;
+  size_t size = 0;
+#ifndef _WIN32
+  void* mapped = MAP_FAILED;
+  int fd = open(_fileName.c_str(), O_RDONLY);
+  struct stat fileStat;
+  if (fd >= 0 && fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+      size = (size_t)fileStat.st_size;
+      mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+          madvise(mapped, size, MADV_SEQUENTIAL);
+          data = (const char*)mapped;
+      }
   }
-  else{
+  if (fd >= 0) {
+      close(fd);
+  }
+#endif
+  if (data == NULL) {
+      std::ifstream file(_fileName.c_str(), std::ios::binary | std::ios::ate);
+      if (file) {
+          fileBuffer.resize((size_t)file.tellg());
+          file.seekg(0);
+          file.read(fileBuffer.data(), fileBuffer.size());
+          fileBuffer.resize((size_t)file.gcount());
+      }
+      size = fileBuffer.size();
+      data = fileBuffer.data();
+  }
+  if (size == 0) {
       std::cout << "Unable to open ppm file: " << _fileName << std::endl;
-  } 
+      return;
+  }
+
+  std::cout << "Reading in ppm file: " << _fileName << std::endl;
+
+  int maxValue = 0;
+  size_t pos = skipSpaceAndComments(data, 0, size);
+  if (pos + 2 > size) {
+      std::cout << "Incorrect image file format.Cannot load texutre" << std::endl;
+  }
+  else {
+      // Read in the magic number
+      magicNumber = std::string(data + pos, 2);
+      pos += 2;
+      std::cout << "Magic Number: " << magicNumber << std::endl;
+      if (magicNumber.compare("P3") != 0) {
+          std::cout <<  "Incorrect image file format.Cannot load texutre" << std::endl;
+      }
+      // Read in dimensions and color range
+      else if (!readHeaderInt(data, pos, size, width) || !readHeaderInt(data, pos, size, height) ||
+               !readHeaderInt(data, pos, size, maxValue) || maxValue <= 0) {
+          std::cout << "PPM not parsed correctly, invalid header" << std::endl;
+          width = 0;
+          height = 0;
+      }
+      else if (width <= 0 || height <= 0) {
+          std::cout << "PPM not parsed correctly, width and height dimensions are 0" << std::endl;
+      }
+      else {
+          std::cout << "width: " << width << " " << "height: " << height << std::endl;
+          std::cout << "color range: 0-" << maxValue << std::endl;
+
+          size_t num = (size_t)width * height * 3;
+          color = new char[num];
+
+          // Cut the body into ranges that end on a line break, so that a range never
+          // starts inside a number or a comment
+          size_t bodyStart = pos;
+          size_t bodySize = size - bodyStart;
+          size_t threadCount = parallelThreadCount((int)std::min(bodySize / MIN_CHUNK_BYTES, (size_t)INT_MAX));
+          std::vector<size_t> bounds(threadCount + 1, size);
+          bounds[0] = bodyStart;
+          for (size_t t = 1; t < threadCount; t++) {
+              size_t cut = std::max(bounds[t - 1], bodyStart + bodySize * t / threadCount);
+              const char* nl = (const char*)memchr(data + cut, '\n', size - cut);
+              bounds[t] = nl ? (size_t)(nl - data) : size;
+          }
+
+          std::vector<std::vector<char> > parts(threadCount);
+          parallelFor((int)threadCount, [&](int first, int last) {
+              for (int t = first; t < last; t++) {
+                  parseRange(data, bounds[t], bounds[t + 1], maxValue, parts[t]);
+              }
+          });
+
+          // Gather the ranges in order
+          size_t filled = 0;
+          for (auto& part : parts) {
+              size_t count = std::min(part.size(), num - filled);
+              memcpy(color + filled, part.data(), count);
+              filled += count;
+          }
+          if (filled < num) {
+              std::cout << "PPM has " << filled << " of " << num << " color values, padding with 0" << std::endl;
+              memset(color + filled, 0, num - filled);
+          }
+      }
+  }
+
+#ifndef _WIN32
+  if (mapped != MAP_FAILED) {
+      munmap(mapped, size);
+  }
+#endif
 }
 
 
 
+/*	===============================================
+Desc:	Constructor for an image generated in memory
+Precondition: _width and _height are positive
+Postcondition: The array 'color' is allocated and cleared to black.
+=============================================== */ 
+ppm::ppm(int _width, int _height){
+	textureID = -1;
+	volumeSize = 0;
+	volumeDepth = 0;
+	slicesUploaded = 0;
+	magicNumber = "P3";
+	width = _width;
+	height = _height;
+	color = new char[(size_t)width * height * 3];
+	memset(color, 0, (size_t)width * height * 3);
+}
+
 /*	===============================================
 Desc:	Default destructor for a ppm
 Precondition: 
@@ -125,7 +274,7 @@ Precondition:
 Postcondition:
 =============================================== */ 
 void ppm::setPixel(int x, int y, int r, int g, int b){
-  if(x > width || y > height){
+  if(x < 0 || y < 0 || x >= width || y >= height){
     return;
   }
   else{
@@ -133,17 +282,48 @@ void ppm::setPixel(int x, int y, int r, int g, int b){
               << x << "," << y << "from (" <<
               (int)color[x*y] << "," << (int)color[x*y+1] << "," << (int)color[x*y+2] << ")";
 */
-    color[(x*3)+height*(y*3)] = r;
-    color[(x*3)+height*(y*3)+1] = g;
-    color[(x*3)+height*(y*3)+2] = b;
+    color[(x*3)+width*(y*3)] = r;
+    color[(x*3)+width*(y*3)+1] = g;
+    color[(x*3)+width*(y*3)+2] = b;
 /*
     std::cout << " to (" << (int)color[x*y] << "," << (int)color[x*y+1] << "," << (int)color[x*y+2] << ")" << std::endl;
 */
   }
 }
 
+/*  ===============================================
+Desc: Writes the image as an ASCII P3 file
+Precondition: 
+Postcondition: Returns false if the file could not be written
+=============================================== */ 
+bool ppm::save(std::string _fileName){
+	if (color == NULL) {
+		return false;
+	}
+	FILE* file = fopen(_fileName.c_str(), "w");
+	if (file == NULL) {
+		std::cout << "Unable to write ppm file: " << _fileName << std::endl;
+		return false;
+	}
+	fprintf(file, "P3\n%d %d\n255\n", width, height);
+	// one image row per line
+	std::string line;
+	char number[8];
+	for (int y = 0; y < height; y++) {
+		line.clear();
+		for (int x = 0; x < width * 3; x++) {
+			int length = snprintf(number, sizeof(number), "%d ", (unsigned char)color[(size_t)y * width * 3 + x]);
+			line.append(number, length);
+		}
+		line.back() = '\n';
+		fputs(line.c_str(), file);
+	}
+	fclose(file);
+	return true;
+}
+
 unsigned int ppm::bindTexture() {
-	if (textureID == -1) {
+	if (textureID == (unsigned int)-1) {
 		glGenTextures(1, &textureID);
 	}
 	glBindTexture(GL_TEXTURE_2D, textureID);
@@ -156,57 +336,107 @@ unsigned int ppm::bindTexture() {
 
 unsigned int ppm::bindTexture3D(unsigned int sizeT) {
 	printf("----------------------------------Binding texture 3d----------------------------------\n");
-	printf("texture id----: %d\n", textureID);
-    if (textureID == -1) {
-        glGenTextures(1, &textureID);
-    }
+	if (beginTexture3D(sizeT) == (unsigned int)-1) {
+		return -1;
+	}
+	uploadTexture3DSlices(volumeDepth);
+	printf("texture 3d bound\n");
+	return textureID;
+}
 
-    // Bind 3D texture
-    glBindTexture(GL_TEXTURE_3D, textureID);
-	printf("texture id: %d\n", textureID);
+int ppm::getVolumeSize() {
+	if (width <= 0 || height <= 0) {
+		return 0;
+	}
+	int size = (int)std::round(std::cbrt((double)width * height));
+	if ((long long)size * size * size != (long long)width * height || width % size != 0 || height % size != 0) {
+		return 0;
+	}
+	return size;
+}
 
-    // Set 3D texture parameters
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Retrieve image data
-    int width = getWidth();
-    int height = getHeight();
-    char* image = getPixels();
-    int nrChannels = 3; // Assume RGB for ppm format
-
-    if (!image) {
-        std::cerr << "Failed to bind 3D texture: Pixel data is empty!" << std::endl;
-        return -1;
-    }
-
-    // Reorganize 2D image data into 3D texture slices
-    int tex2Dsize = sizeT;
-    int depth = (width / tex2Dsize) * (height / tex2Dsize);
-    int tex2Dblock = width / tex2Dsize;
-    char* fimage = new char[width * height * nrChannels];
-
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            unsigned int indexM = (j / tex2Dsize) * tex2Dblock + (i / tex2Dsize);
-            indexM = indexM * tex2Dsize * tex2Dsize + (j % tex2Dsize) * tex2Dsize + (i % tex2Dsize);
-            for (int k = 0; k < nrChannels; k++) {
-                fimage[nrChannels * indexM + k] = image[nrChannels * (width * j + i) + k];
-            }
-        }
-    }
-
-    // Upload the 3D texture data to GPU
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB, tex2Dsize, tex2Dsize, depth, 0, GL_RGB, GL_UNSIGNED_BYTE, fimage);
+/*	===============================================
+Desc:	Rearranges the tiled image into 3D texture slices and allocates the texture
+		storage, without uploading any slice yet.
+Precondition: The image is a grid of sizeT x sizeT tiles, one tile per slice, read row by row.
+Postcondition: Slices can be uploaded with uploadTexture3DSlices. The storage is undefined
+		until they are, so the texture is not to be sampled before.
+=============================================== */
+unsigned int ppm::beginTexture3D(unsigned int sizeT) {
+	// Retrieve image data
+	char* image = getPixels();
+	if (!image || sizeT == 0 || width < (int)sizeT || height < (int)sizeT) {
+		std::cerr << "Failed to bind 3D texture: Pixel data is empty!" << std::endl;
+		return -1;
+	}
+
+	if (textureID == (unsigned int)-1) {
+		glGenTextures(1, &textureID);
+	}
+
+	// Bind 3D texture
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_3D, textureID);
+	printf("texture id: %d\n", textureID);
 
-    delete[] fimage;
-	printf("texture 3d bound\n");
-    return textureID;
+	// Set 3D texture parameters
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// Reorganize 2D image data into 3D texture slices
+	volumeSize = sizeT;
+	int tex2Dblock = width / volumeSize;
+	volumeDepth = tex2Dblock * (height / volumeSize);
+	slicesUploaded = 0;
+	volume.resize((size_t)volumeSize * volumeSize * volumeDepth * 3);
+
+	// Walk in destination order: every slice row is one contiguous row of its source tile,
+	// so each thread copies whole rows for its own range of slices
+	size_t rowBytes = (size_t)volumeSize * 3;
+	auto reshuffle = [&](int firstSlice, int lastSlice) {
+		for (int slice = firstSlice; slice < lastSlice; slice++) {
+			int tileX = (slice % tex2Dblock) * volumeSize;
+			int tileY = (slice / tex2Dblock) * volumeSize;
+			char* dst = &volume[(size_t)slice * volumeSize * rowBytes];
+			for (int y = 0; y < volumeSize; y++) {
+				memcpy(dst + y * rowBytes, image + ((size_t)(tileY + y) * width + tileX) * 3, rowBytes);
+			}
+		}
+	};
+	parallelFor(volumeDepth, reshuffle);
+
+	// Allocate the storage, slices are filled in by uploadTexture3DSlices
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB, volumeSize, volumeSize, volumeDepth, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	return textureID;
+}
+
+/*	===============================================
+Desc:	Uploads up to maxSlices of the slices prepared by beginTexture3D
+Precondition: beginTexture3D was called
+Postcondition: Returns true once every slice is on the GPU, the reshuffled copy is then freed.
+=============================================== */
+bool ppm::uploadTexture3DSlices(int maxSlices) {
+	if (textureID == (unsigned int)-1 || volume.empty()) {
+		return true;
+	}
+	int count = std::min(maxSlices, volumeDepth - slicesUploaded);
+	if (count > 0) {
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_3D, textureID);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, slicesUploaded, volumeSize, volumeSize, count, GL_RGB, GL_UNSIGNED_BYTE,
+			&volume[(size_t)slicesUploaded * volumeSize * volumeSize * 3]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		slicesUploaded += count;
+	}
+	if (slicesUploaded < volumeDepth) {
+		return false;
+	}
+	std::vector<char>().swap(volume);
+	return true;
 }
 
 unsigned int ppm::getTextureID() {
@@ -214,7 +444,8 @@ unsigned int ppm::getTextureID() {
 }
 
 void ppm::releaseTexture() {
-	if (textureID != -1) {
+	std::vector<char>().swap(volume);
+	if (textureID != (unsigned int)-1) {
 		glDeleteTextures(1, &textureID);
 		textureID = -1;
 	}
@@ -0,0 +1,404 @@
+// Offline benchmark of the scene and PLY loading path and of the mesh kd-tree, no window or GL needed.
+//
+// For every asset it times the parse, tessellation, triangle array and kd-tree builds, sizes the
+// texture buffers the canvas would upload, collects tree statistics, and traces an orbit of views
+// through the tree on the CPU with the same traversal as object-frag.shader:
+//   benchmark                                  every scene and PLY under data/
+//   benchmark --out before.json data/ply/bunny.ply data/Brown/mesh.xml
+//
+// Build with `make benchmark`. The JSON is meant to be diffed across commits.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <dirent.h>
+#include <glm/glm.hpp>
+#include "objects/SceneGraph.h"
+#include "scene/SceneParser.h"
+#include "shaders/ply.h"
+
+namespace {
+
+// scene folders and PLY folder of the bundled corpus
+const char* SCENE_DIRS[] = { "data/Test", "data/Tufts", "data/Brown", "data/Baylor", "data/RecursiveRayDemo" };
+const char* PLY_DIR = "data/ply";
+
+// same limits as MyGLCanvas
+const size_t MAX_BUFFER_SIZE = 16 * 1024 * 1024;
+const size_t FLOATS_PER_TRIANGLE = 18;
+const size_t FLOATS_PER_NODE = 15;
+const int MAX_STACK_SIZE = 1000;
+
+struct Options {
+    std::string out = "benchmark.json";
+    int width = 160;
+    int height = 120;
+    int views = 8;
+    int segmentsX = 10;
+    int segmentsY = 10;
+    std::vector<std::string> assets;
+};
+
+struct TraceStats {
+    long long rays = 0;
+    long long hits = 0;
+    long long nodesVisited = 0;
+    long long trianglesTested = 0;
+    double milliseconds = 0.0;
+};
+
+struct AssetResult {
+    std::string name;
+    std::string type;
+    std::string error;
+    size_t triangles = 0;
+    double parseMs = 0.0, tessellateMs = 0.0, arrayMs = 0.0, treeMs = 0.0;
+    size_t meshBytes = 0, treeBytes = 0;
+    int meshBuffers = 0, treeBuffers = 0;
+    meshKDTreeStats tree;
+    TraceStats trace;
+};
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] [scene.xml|mesh.ply ...]\n"
+              << "  --out <file|->           JSON output (default benchmark.json)\n"
+              << "  --size <w> <h>           rays per view (default 160 120)\n"
+              << "  --views <int>            views on the orbit around each asset (default 8)\n"
+              << "  --segments <x> <y>       tessellation of scene primitives (default 10 10)\n"
+              << "Without assets every scene under data/{Test,Tufts,Brown,Baylor,RecursiveRayDemo} and PLY under data/ply is run.\n";
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool hasSuffix(const std::string& name, const std::string& suffix) {
+    return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// files of a folder and its subfolders with the extension, sorted so runs list assets in the same order
+void listFiles(const std::string& dir, const std::string& extension, std::vector<std::string>& files) {
+    DIR* handle = opendir(dir.c_str());
+    if (handle == NULL) {
+        return;
+    }
+    std::vector<std::string> found, subdirs;
+    for (dirent* entry = readdir(handle); entry != NULL; entry = readdir(handle)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        if (entry->d_type == DT_DIR) {
+            subdirs.push_back(dir + "/" + name);
+        }
+        else if (hasSuffix(name, extension)) {
+            found.push_back(dir + "/" + name);
+        }
+    }
+    closedir(handle);
+    std::sort(found.begin(), found.end());
+    std::sort(subdirs.begin(), subdirs.end());
+    files.insert(files.end(), found.begin(), found.end());
+    for (const std::string& subdir : subdirs) {
+        listFiles(subdir, extension, files);
+    }
+}
+
+// intersectionAABB of object-frag.shader, entry distance or -1
+float intersectBox(const float* boxMin, const float* boxMax, const glm::vec3& origin, const glm::vec3& direction) {
+    float tnear = -1e10f, tfar = 1e10f;
+    for (int i = 0; i < 3; i++) {
+        if (direction[i] != 0.0f) {
+            float t1 = (boxMin[i] - origin[i]) / direction[i];
+            float t2 = (boxMax[i] - origin[i]) / direction[i];
+            if (t1 > t2) std::swap(t1, t2);
+            tnear = std::max(tnear, t1);
+            tfar = std::min(tfar, t2);
+            if (tnear > tfar || tfar < 0.0f) return -1.0f;
+        }
+        else if (origin[i] < boxMin[i] || origin[i] > boxMax[i]) {
+            return -1.0f;
+        }
+    }
+    return tnear;
+}
+
+// intersectionTriangle of object-frag.shader
+float intersectTriangle(const float* v, const glm::vec3& origin, const glm::vec3& direction) {
+    glm::vec3 v1(v[0], v[1], v[2]), v2(v[3], v[4], v[5]), v3(v[6], v[7], v[8]);
+    glm::vec3 e1 = v2 - v1, e2 = v3 - v1;
+    glm::vec3 pvec = glm::cross(direction, e2);
+    float det = glm::dot(e1, pvec);
+    if (std::fabs(det) < 1e-6f) return -1.0f;
+    float invDet = 1.0f / det;
+    glm::vec3 tvec = origin - v1;
+    float u = glm::dot(tvec, pvec) * invDet;
+    if (u < 0.0f || u > 1.0f) return -1.0f;
+    glm::vec3 qvec = glm::cross(tvec, e1);
+    float w = glm::dot(direction, qvec) * invDet;
+    if (w < 0.0f || u + w > 1.0f) return -1.0f;
+    float t = glm::dot(e2, qvec) * invDet;
+    return t > 0.0f ? t : -1.0f;
+}
+
+// intersectionKDTree of object-frag.shader: every node whose box the ray hits is visited,
+// leaves test at most the 6 triangles the array layout keeps
+float traceKDTree(const meshKDTree& tree, const std::vector<float>& array, const glm::vec3& origin, const glm::vec3& direction, TraceStats& stats) {
+    int stack[MAX_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = tree.rootIndex;
+    float t = -1.0f;
+    while (stackSize > 0) {
+        const meshKDTreeNode& node = tree.nodes[stack[--stackSize]];
+        stats.nodesVisited++;
+        if (node.left == -1) {
+            int count = std::min((int)node.faceIndexes.size(), 6);
+            for (int j = 0; j < count; j++) {
+                stats.trianglesTested++;
+                float hit = intersectTriangle(&array[node.faceIndexes[j] * FLOATS_PER_TRIANGLE], origin, direction);
+                if (hit > 0.0f && (t < 0.0f || hit < t)) t = hit;
+            }
+        }
+        else {
+            const meshKDTreeNode& left = tree.nodes[node.left];
+            const meshKDTreeNode& right = tree.nodes[node.right];
+            if (stackSize < MAX_STACK_SIZE && intersectBox(left.min_xyz, left.max_xyz, origin, direction) >= 0.0f) {
+                stack[stackSize++] = node.left;
+            }
+            if (stackSize < MAX_STACK_SIZE && intersectBox(right.min_xyz, right.max_xyz, origin, direction) >= 0.0f) {
+                stack[stackSize++] = node.right;
+            }
+        }
+    }
+    return t;
+}
+
+// Orbit of views around the root box at a fixed elevation, 60 degree field of view, far enough
+// for the bounding sphere to fit, so a run only depends on the asset and the options
+TraceStats traceViews(const meshKDTree& tree, const std::vector<float>& array, const Options& options) {
+    TraceStats stats;
+    if (tree.nodes.empty() || array.empty()) {
+        return stats;
+    }
+    const meshKDTreeNode& root = tree.nodes[tree.rootIndex];
+    glm::vec3 boxMin(root.min_xyz[0], root.min_xyz[1], root.min_xyz[2]);
+    glm::vec3 boxMax(root.max_xyz[0], root.max_xyz[1], root.max_xyz[2]);
+    glm::vec3 center = (boxMin + boxMax) * 0.5f;
+    float radius = std::max(glm::length(boxMax - boxMin) * 0.5f, 1e-3f);
+    float H = std::tan(glm::radians(30.0f));
+    float W = H * options.width / options.height;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int view = 0; view < options.views; view++) {
+        float angle = 2.0f * glm::pi<float>() * view / options.views;
+        float elevation = glm::radians(25.0f);
+        glm::vec3 eye = center + 2.0f * radius * glm::vec3(std::cos(angle) * std::cos(elevation), std::sin(elevation), std::sin(angle) * std::cos(elevation));
+        glm::vec3 look = glm::normalize(center - eye);
+        glm::vec3 u = glm::normalize(glm::cross(look, glm::vec3(0.0f, 1.0f, 0.0f)));
+        glm::vec3 v = glm::cross(u, look);
+        for (int y = 0; y < options.height; y++) {
+            for (int x = 0; x < options.width; x++) {
+                float a = -W + 2.0f * W * (x + 0.5f) / options.width;
+                float b = -H + 2.0f * H * (y + 0.5f) / options.height;
+                glm::vec3 direction = glm::normalize(look + a * u + b * v);
+                if (traceKDTree(tree, array, eye, direction, stats) > 0.0f) {
+                    stats.hits++;
+                }
+                stats.rays++;
+            }
+        }
+    }
+    stats.milliseconds = elapsedMs(start);
+    return stats;
+}
+
+// Array and tree phases shared by scenes and PLYs, array holds the triangles
+void buildTree(std::vector<float>& array, AssetResult& result, const Options& options) {
+    result.triangles = array.size() / FLOATS_PER_TRIANGLE;
+    result.meshBytes = array.size() * sizeof(float);
+    size_t trianglesPerBuffer = MAX_BUFFER_SIZE / (FLOATS_PER_TRIANGLE * sizeof(float));
+    result.meshBuffers = (int)((result.triangles + trianglesPerBuffer - 1) / trianglesPerBuffer);
+
+    auto start = std::chrono::steady_clock::now();
+    meshKDTree tree;
+    tree.build(array);
+    std::vector<float> treeArray;
+    tree.buildArray(treeArray);
+    result.treeMs = elapsedMs(start);
+
+    size_t nodesPerBuffer = MAX_BUFFER_SIZE / (FLOATS_PER_NODE * sizeof(float));
+    result.treeBytes = treeArray.size() * sizeof(float);
+    result.treeBuffers = (int)((tree.nodes.size() + nodesPerBuffer - 1) / nodesPerBuffer);
+    result.tree = tree.getStats();
+    result.trace = traceViews(tree, array, options);
+}
+
+// MyGLCanvas::loadSceneFile without the GL upload
+AssetResult runScene(const std::string& filename, const Options& options) {
+    AssetResult result;
+    result.name = filename;
+    result.type = "scene";
+
+    auto start = std::chrono::steady_clock::now();
+    SceneParser parser(filename);
+    bool success = parser.parse();
+    result.parseMs = elapsedMs(start);
+    if (!success) {
+        result.error = "parse failed";
+        return result;
+    }
+
+    start = std::chrono::steady_clock::now();
+    SceneGraph scene;
+    scene.flatten(parser.getRootNode(), glm::mat4(1.0f));
+    scene.calculate();
+    result.tessellateMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<float> array;
+    scene.buildArray(array);
+    result.arrayMs = elapsedMs(start);
+
+    buildTree(array, result, options);
+    return result;
+}
+
+// MyGLCanvas::loadPLY without the GL upload, loading includes the scale and center
+AssetResult runPLY(const std::string& filename, const Options& options) {
+    AssetResult result;
+    result.name = filename;
+    result.type = "ply";
+
+    auto start = std::chrono::steady_clock::now();
+    ply mesh(filename);
+    result.parseMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<float> array;
+    mesh.buildArray(array, glm::mat4(1.0f));
+    result.arrayMs = elapsedMs(start);
+    if (array.empty()) {
+        result.error = "no triangles";
+        return result;
+    }
+
+    buildTree(array, result, options);
+    return result;
+}
+
+std::string jsonString(const std::string& value) {
+    std::string escaped = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+void writeJSON(std::ostream& out, const std::vector<AssetResult>& results, const Options& options) {
+    out << "{\n";
+    out << "  \"rays_per_view\": [" << options.width << ", " << options.height << "],\n";
+    out << "  \"views\": " << options.views << ",\n";
+    out << "  \"segments\": [" << options.segmentsX << ", " << options.segmentsY << "],\n";
+    out << "  \"assets\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const AssetResult& r = results[i];
+        out << "    {\n";
+        out << "      \"name\": " << jsonString(r.name) << ",\n";
+        out << "      \"type\": " << jsonString(r.type) << ",\n";
+        if (!r.error.empty()) {
+            out << "      \"error\": " << jsonString(r.error) << ",\n";
+        }
+        out << "      \"triangles\": " << r.triangles << ",\n";
+        out << "      \"parse_ms\": " << r.parseMs << ",\n";
+        out << "      \"tessellate_ms\": " << r.tessellateMs << ",\n";
+        out << "      \"array_ms\": " << r.arrayMs << ",\n";
+        out << "      \"tree_ms\": " << r.treeMs << ",\n";
+        out << "      \"upload\": { \"mesh_bytes\": " << r.meshBytes << ", \"mesh_buffers\": " << r.meshBuffers
+            << ", \"tree_bytes\": " << r.treeBytes << ", \"tree_buffers\": " << r.treeBuffers << " },\n";
+        out << "      \"tree\": { \"nodes\": " << r.tree.nodes << ", \"leaves\": " << r.tree.leaves
+            << ", \"max_depth\": " << r.tree.maxDepth << ", \"mean_leaf_depth\": " << r.tree.meanLeafDepth
+            << ", \"sah_cost\": " << r.tree.sahCost << ", \"mean_leaf_triangles\": " << r.tree.meanLeafTriangles
+            << ", \"max_leaf_triangles\": " << r.tree.maxLeafTriangles << ", \"empty_leaves\": " << r.tree.emptyLeaves
+            << ", \"truncated_leaves\": " << r.tree.truncatedLeaves << " },\n";
+        const TraceStats& t = r.trace;
+        double rays = std::max(t.rays, 1LL);
+        out << "      \"trace\": { \"rays\": " << t.rays << ", \"ms\": " << t.milliseconds
+            << ", \"rays_per_second\": " << (t.milliseconds > 0.0 ? t.rays / (t.milliseconds / 1000.0) : 0.0)
+            << ", \"hit_rate\": " << t.hits / rays << ", \"nodes_per_ray\": " << t.nodesVisited / rays
+            << ", \"triangles_per_ray\": " << t.trianglesTested / rays << " }\n";
+        out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        // number of values that must follow the option
+        int needed = (arg == "--size" || arg == "--segments") ? 2 : (arg == "--out" || arg == "--views") ? 1 : 0;
+        if (i + needed >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return 1;
+        }
+        if (arg == "--out") options.out = argv[++i];
+        else if (arg == "--size") { options.width = atoi(argv[++i]); options.height = atoi(argv[++i]); }
+        else if (arg == "--views") options.views = atoi(argv[++i]);
+        else if (arg == "--segments") { options.segmentsX = atoi(argv[++i]); options.segmentsY = atoi(argv[++i]); }
+        else if (arg == "--help" || arg == "-h") { printUsage(argv[0]); return 0; }
+        else if (arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Unknown option " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        else options.assets.push_back(arg);
+    }
+    if (options.width < 1 || options.height < 1 || options.views < 0 || options.segmentsX < 1 || options.segmentsY < 1) {
+        std::cerr << "Invalid parameters" << std::endl;
+        return 1;
+    }
+    if (options.assets.empty()) {
+        for (const char* dir : SCENE_DIRS) {
+            listFiles(dir, ".xml", options.assets);
+        }
+        listFiles(PLY_DIR, ".ply", options.assets);
+    }
+    if (options.assets.empty()) {
+        std::cerr << "No assets, run from the repository root or list them" << std::endl;
+        return 1;
+    }
+
+    Shape::setSegments(options.segmentsX, options.segmentsY);
+    std::vector<AssetResult> results;
+    for (const std::string& asset : options.assets) {
+        AssetResult result = hasSuffix(asset, ".ply") ? runPLY(asset, options) : runScene(asset, options);
+        std::cerr << asset << ": " << result.triangles << " triangles, " << result.tree.nodes << " nodes, "
+                  << (result.trace.milliseconds > 0.0 ? result.trace.rays / (result.trace.milliseconds / 1000.0) / 1e6 : 0.0)
+                  << " Mrays/s" << (result.error.empty() ? "" : " (" + result.error + ")") << std::endl;
+        results.push_back(result);
+    }
+
+    if (options.out == "-") {
+        writeJSON(std::cout, results, options);
+        return 0;
+    }
+    std::ofstream file(options.out);
+    if (!file) {
+        std::cerr << "Unable to write " << options.out << std::endl;
+        return 1;
+    }
+    writeJSON(file, results, options);
+    std::cerr << results.size() << " assets written to " << options.out << std::endl;
+    return 0;
+}
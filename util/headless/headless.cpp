@@ -0,0 +1,657 @@
+// Renders a scene without a window or display, for render machines and CI.
+//
+// Creates an offscreen OpenGL 3.3 core context with EGL (surfaceless on Mesa / llvmpipe, a
+// pbuffer elsewhere), runs the canvas passes into a framebuffer and writes the image:
+//   headless --size 640 480 --out frame.png data/Test/cornellbox.xml
+//   headless --eye 0 2 8 --look-at 0 0 0 --samples 16 --out frame.exr data/ply/bunny.ply
+//
+// Frames are rendered until the image stops changing, as the window would, and background
+// work is waited for, so the same inputs on the same driver give the same bytes.
+//
+// Sequences follow a camera path at a fixed time step per frame:
+//   headless --path util/headless/flythrough.path --time-step 2 --out frames/sea_%04d.png
+// The readback of a frame runs while the next one renders and the files are written on a
+// thread of their own, so neither the copy nor the disk holds up the GPU.
+//
+// Build with `make headless`, run from the repository root (shaders and data are relative).
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "MyGLCanvas.h"
+#include "shaders/imageFile.h"
+#include "shaders/ppm.h"
+
+namespace {
+
+struct Options {
+    std::string asset;
+    std::string out = "render.png";
+    std::string path;
+    bool hasFrames = false;
+    int firstFrame = 0;
+    int lastFrame = 0;
+    int timeStep = 1;
+    int width = 640;
+    int height = 480;
+    int samples = 0;
+    int frame = 0;
+    int quality = 1;
+    int costView = 0;
+    int maxFrames = 1024;
+    bool hasEye = false, hasLookAt = false, hasLook = false, hasUp = false;
+    glm::vec3 eye, lookAt, look, up;
+    float fov = 0.0f;
+};
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] [scene.xml|mesh.ply]\n"
+              << "  --out <file>             .png, .ppm or .exr (default render.png)\n"
+              << "  --size <w> <h>           resolution (default 640 480)\n"
+              << "  --eye <x> <y> <z>        camera position, instead of the scene camera\n"
+              << "  --look-at <x> <y> <z>    point the camera looks at\n"
+              << "  --look <x> <y> <z>       direction the camera looks in\n"
+              << "  --up <x> <y> <z>         camera up vector\n"
+              << "  --fov <degrees>          vertical view angle\n"
+              << "  --samples <int>          progressive refinement samples, 0 renders one (default 0)\n"
+              << "  --frame <int>            animation time of the ocean and the clouds (default 0)\n"
+              << "  --path <file>            camera keyframes to follow, one per line:\n"
+              << "                           <frame> <eye x y z> <look-at x y z> [<up x y z> [<fov>]]\n"
+              << "  --frames <first> <last>  frames of a sequence (default the frames of the path)\n"
+              << "  --time-step <int>        animation time per frame, frame n is at --frame + n * step (default 1)\n"
+              << "  --quality <0-2>          object pass targets, as the Render Quality choice (default 1)\n"
+              << "  --cost-view <0-4>        heatmap of nodes, triangles, sea steps or cloud steps (default 0, the image)\n"
+              << "  --max-frames <int>       frames rendered at most while the image settles (default 1024)\n"
+              << "Without a scene the ocean and the clouds are rendered. Files of a sequence are named by a\n"
+              << "%d or %04d in --out, or get _0001 style numbers before the extension.\n";
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool hasSuffix(const std::string& name, const std::string& suffix) {
+    return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool hasExtension(const char* extensions, const char* name) {
+    return extensions != NULL && strstr(extensions, name) != NULL;
+}
+
+// Offscreen OpenGL 3.3 core context, made current
+struct EGLState {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+};
+
+bool createContext(EGLState& egl) {
+    // Mesa renders without any display server on its surfaceless platform
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay != NULL) {
+            egl.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+    if (egl.display == EGL_NO_DISPLAY) {
+        egl.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major, minor;
+    if (egl.display == EGL_NO_DISPLAY || !eglInitialize(egl.display, &major, &minor)) {
+        std::cerr << "No EGL display" << std::endl;
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL has no desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(egl.display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+        std::cerr << "No EGL config for OpenGL" << std::endl;
+        return false;
+    }
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    egl.context = eglCreateContext(egl.display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (egl.context == EGL_NO_CONTEXT) {
+        std::cerr << "Unable to create an OpenGL 3.3 core context" << std::endl;
+        return false;
+    }
+
+    // every pass draws into framebuffer objects, a pbuffer is only needed without surfaceless contexts
+    if (!hasExtension(eglQueryString(egl.display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+        const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        egl.surface = eglCreatePbufferSurface(egl.display, config, pbufferAttributes);
+    }
+    if (!eglMakeCurrent(egl.display, egl.surface, egl.surface, egl.context)) {
+        std::cerr << "Unable to make the context current" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void destroyContext(EGLState& egl) {
+    if (egl.display == EGL_NO_DISPLAY) {
+        return;
+    }
+    eglMakeCurrent(egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (egl.surface != EGL_NO_SURFACE) eglDestroySurface(egl.display, egl.surface);
+    if (egl.context != EGL_NO_CONTEXT) eglDestroyContext(egl.display, egl.context);
+    eglTerminate(egl.display);
+}
+
+bool loadGL() {
+    glewExperimental = GL_TRUE;
+    GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // a GLX build of GLEW finds no X display under EGL, the entry points still load
+    if (err == GLEW_ERROR_NO_GLX_DISPLAY) {
+        err = glewContextInit();
+    }
+#endif
+    if (err != GLEW_OK) {
+        std::cerr << "Error: " << glewGetErrorString(err) << std::endl;
+        return false;
+    }
+    // GLEW may leave an error behind on core contexts
+    while (glGetError() != GL_NO_ERROR) {
+    }
+    return true;
+}
+
+// Float target the environment pass draws into, so values above 1 survive for EXR
+struct Target {
+    GLuint fbo = 0;
+    GLuint texture = 0;
+};
+
+Target createTarget(int width, int height) {
+    Target target;
+    glGenTextures(1, &target.texture);
+    glBindTexture(GL_TEXTURE_2D, target.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &target.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Output framebuffer not complete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return target;
+}
+
+// Two pixel pack buffers: the copy of frame N into one runs on the GPU while frame N + 1
+// renders, and it is only mapped after that, when the copy is long done
+struct Readback {
+    GLuint buffers[2] = { 0, 0 };
+    std::string names[2];       // file of the frame each buffer holds, empty when free
+    int next = 0;
+};
+
+void createReadback(Readback& readback, int width, int height) {
+    glGenBuffers(2, readback.buffers);
+    for (GLuint buffer : readback.buffers) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4 * sizeof(float), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Queues the copy of the target, RGBA as the target stores it so the driver needs no conversion
+void startReadback(Readback& readback, const Target& target, int width, int height, const std::string& name) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffers[readback.next]);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    readback.names[readback.next] = name;
+    readback.next = 1 - readback.next;
+}
+
+// Pixels of a buffer, RGBA rows bottom first; empty when it holds no frame
+std::vector<float> finishReadback(Readback& readback, int buffer, int width, int height, std::string& name) {
+    std::vector<float> pixels;
+    name.swap(readback.names[buffer]);
+    readback.names[buffer].clear();
+    if (name.empty()) {
+        return pixels;
+    }
+    size_t size = (size_t)width * height * 4 * sizeof(float);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffers[buffer]);
+    const float* mapped = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (mapped != NULL) {
+        pixels.assign(mapped, mapped + size / sizeof(float));
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return pixels;
+}
+
+// RGB rows top first from the RGBA rows bottom first of glReadPixels
+std::vector<float> toImage(const std::vector<float>& rgba, int width, int height) {
+    std::vector<float> rgb((size_t)width * height * 3);
+    for (int y = 0; y < height; y++) {
+        const float* src = &rgba[(size_t)(height - 1 - y) * width * 4];
+        float* dst = &rgb[(size_t)y * width * 3];
+        for (int x = 0; x < width; x++) {
+            dst[x * 3 + 0] = src[x * 4 + 0];
+            dst[x * 3 + 1] = src[x * 4 + 1];
+            dst[x * 3 + 2] = src[x * 4 + 2];
+        }
+    }
+    return rgb;
+}
+
+// Writes the format of the file extension, 8 bit formats round as the window framebuffer does
+bool writeImage(const std::string& fileName, int width, int height, const std::vector<float>& pixels) {
+    if (hasSuffix(fileName, ".exr")) {
+        return writeEXR(fileName, width, height, pixels);
+    }
+    std::vector<unsigned char> bytes(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++) {
+        bytes[i] = (unsigned char)(std::min(std::max(pixels[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+    if (hasSuffix(fileName, ".ppm")) {
+        ppm image(width, height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const unsigned char* rgb = &bytes[((size_t)y * width + x) * 3];
+                image.setPixel(x, y, rgb[0], rgb[1], rgb[2]);
+            }
+        }
+        return image.save(fileName);
+    }
+    return writePNG(fileName, width, height, bytes);
+}
+
+// Encodes and writes frames on a thread of its own. At most MAX_QUEUED frames wait, beyond
+// that queue() blocks until the disk catches up, which bounds the memory of long sequences.
+class FrameWriter {
+public:
+    FrameWriter(int width, int height) : width(width), height(height) {
+        thread = std::thread(&FrameWriter::run, this);
+    }
+
+    ~FrameWriter() {
+        finish();
+    }
+
+    void queue(const std::string& fileName, std::vector<float> rgba) {
+        std::unique_lock<std::mutex> lock(mutex);
+        spaceFree.wait(lock, [this] { return frames.size() < MAX_QUEUED; });
+        frames.push_back({ fileName, std::move(rgba) });
+        frameQueued.notify_one();
+    }
+
+    // Waits for every queued frame, returns how many could not be written
+    int finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        frameQueued.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+        return failed;
+    }
+
+private:
+    static const size_t MAX_QUEUED = 4;
+
+    struct Frame {
+        std::string fileName;
+        std::vector<float> rgba;
+    };
+
+    void run() {
+        for (;;) {
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                frameQueued.wait(lock, [this] { return !frames.empty() || done; });
+                if (frames.empty()) {
+                    return;
+                }
+                frame = std::move(frames.front());
+                frames.pop_front();
+            }
+            spaceFree.notify_one();
+            if (!writeImage(frame.fileName, width, height, toImage(frame.rgba, width, height))) {
+                std::cerr << "Unable to write " << frame.fileName << std::endl;
+                failed++;
+            }
+        }
+    }
+
+    int width, height;
+    std::deque<Frame> frames;
+    std::mutex mutex;
+    std::condition_variable frameQueued, spaceFree;
+    bool done = false;
+    int failed = 0;
+    std::thread thread;
+};
+
+// File of frame n: a %d or %0<width>d in the pattern is replaced by the number, a pattern
+// without one gets _%04d before its extension when there are several frames
+std::string frameName(const std::string& pattern, int n, bool sequence) {
+    size_t start = pattern.find('%');
+    if (start == std::string::npos) {
+        if (!sequence) {
+            return pattern;
+        }
+        size_t dot = pattern.rfind('.');
+        return frameName(pattern.substr(0, dot) + "_%04d" + pattern.substr(dot), n, sequence);
+    }
+    size_t end = start + 1;
+    while (end < pattern.size() && isdigit((unsigned char)pattern[end])) {
+        end++;
+    }
+    int width = end > start + 1 ? atoi(pattern.substr(start + 1, end - start - 1).c_str()) : 0;
+    std::string number = std::to_string(n);
+    if ((int)number.size() < width) {
+        number.insert(0, width - number.size(), '0');
+    }
+    return pattern.substr(0, start) + number + pattern.substr(end + 1);
+}
+
+bool validPattern(const std::string& pattern) {
+    size_t start = pattern.find('%');
+    if (start == std::string::npos) {
+        return true;
+    }
+    size_t end = start + 1;
+    while (end < pattern.size() && isdigit((unsigned char)pattern[end])) {
+        end++;
+    }
+    return end < pattern.size() && pattern[end] == 'd' && pattern.find('%', end) == std::string::npos;
+}
+
+// Camera of one frame of a path, the arguments of Camera::orientLookAt and the view angle
+struct Keyframe {
+    int frame;
+    glm::vec3 eye, lookAt, up;
+    float fov;
+};
+
+// One keyframe per line: frame, eye, look-at point and optionally up and the view angle.
+// Frames must increase; a left out up or view angle repeats the one of the keyframe before,
+// the first one takes (0, 1, 0) and the angle of the scene camera. # starts a comment.
+bool loadPath(const std::string& fileName, float sceneFov, std::vector<Keyframe>& keys) {
+    std::ifstream file(fileName);
+    if (!file) {
+        std::cerr << "Unable to open camera path " << fileName << std::endl;
+        return false;
+    }
+    glm::vec3 up(0.0f, 1.0f, 0.0f);
+    float fov = sceneFov;
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream values(line);
+        Keyframe key;
+        if (!(values >> key.frame)) {
+            continue;
+        }
+        if (!(values >> key.eye.x >> key.eye.y >> key.eye.z >> key.lookAt.x >> key.lookAt.y >> key.lookAt.z)) {
+            std::cerr << fileName << ":" << lineNumber << ": expected a frame, an eye point and a look-at point" << std::endl;
+            return false;
+        }
+        if (values >> up.x) {
+            if (!(values >> up.y >> up.z)) {
+                std::cerr << fileName << ":" << lineNumber << ": incomplete up vector" << std::endl;
+                return false;
+            }
+            values >> fov;
+        }
+        key.up = up;
+        key.fov = fov;
+        if (!keys.empty() && key.frame <= keys.back().frame) {
+            std::cerr << fileName << ":" << lineNumber << ": frame " << key.frame << " does not follow frame " << keys.back().frame << std::endl;
+            return false;
+        }
+        keys.push_back(key);
+    }
+    if (keys.empty()) {
+        std::cerr << "No keyframes in " << fileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Cubic Hermite segment from p1 to p2 with Catmull-Rom tangents scaled by the frame spacing,
+// so the speed stays continuous across keys that are not evenly spaced. Frames outside of
+// the path hold its first or last key.
+template <typename T>
+T splineValue(const std::vector<Keyframe>& keys, T Keyframe::*member, float frame) {
+    if (frame <= keys.front().frame) {
+        return keys.front().*member;
+    }
+    if (frame >= keys.back().frame) {
+        return keys.back().*member;
+    }
+    size_t i = 0;
+    while (keys[i + 1].frame <= frame) {
+        i++;
+    }
+    const Keyframe& k0 = keys[i > 0 ? i - 1 : i];
+    const Keyframe& k1 = keys[i];
+    const Keyframe& k2 = keys[i + 1];
+    const Keyframe& k3 = keys[i + 2 < keys.size() ? i + 2 : i + 1];
+    float span = float(k2.frame - k1.frame);
+    T m1 = (k2.*member - k0.*member) * (span / float(k2.frame - k0.frame));
+    T m2 = (k3.*member - k1.*member) * (span / float(k3.frame - k1.frame));
+    float t = (frame - k1.frame) / span;
+    float t2 = t * t, t3 = t2 * t;
+    return k1.*member * (2.0f * t3 - 3.0f * t2 + 1.0f) + m1 * (t3 - 2.0f * t2 + t)
+        + k2.*member * (3.0f * t2 - 2.0f * t3) + m2 * (t3 - t2);
+}
+
+void applyPath(Camera* camera, const std::vector<Keyframe>& keys, int frame) {
+    camera->setViewAngle(splineValue(keys, &Keyframe::fov, float(frame)));
+    camera->orientLookAt(splineValue(keys, &Keyframe::eye, float(frame)), splineValue(keys, &Keyframe::lookAt, float(frame)),
+        glm::normalize(splineValue(keys, &Keyframe::up, float(frame))));
+}
+
+// Scene camera with the overrides of the command line
+void applyCamera(Camera* camera, const Options& options) {
+    if (options.fov > 0.0f) {
+        camera->setViewAngle(options.fov);
+    }
+    if (!options.hasEye && !options.hasLookAt && !options.hasLook && !options.hasUp) {
+        return;
+    }
+    glm::vec3 eye = options.hasEye ? options.eye : camera->getEyePoint();
+    glm::vec3 up = options.hasUp ? options.up : camera->getUpVector();
+    if (options.hasLookAt) {
+        camera->orientLookAt(eye, options.lookAt, up);
+    }
+    else {
+        camera->orientLookVec(eye, options.hasLook ? options.look : camera->getLookVector(), up);
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        // number of values that must follow the option
+        int needed = 0;
+        if (arg == "--eye" || arg == "--look-at" || arg == "--look" || arg == "--up") needed = 3;
+        else if (arg == "--size" || arg == "--frames") needed = 2;
+        else if (arg == "--out" || arg == "--fov" || arg == "--samples" || arg == "--frame" || arg == "--quality" || arg == "--cost-view"
+            || arg == "--max-frames" || arg == "--path" || arg == "--time-step") needed = 1;
+        if (i + needed >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return 1;
+        }
+        if (arg == "--out") options.out = argv[++i];
+        else if (arg == "--size") { options.width = atoi(argv[++i]); options.height = atoi(argv[++i]); }
+        else if (arg == "--eye") { options.hasEye = true; for (int k = 0; k < 3; k++) options.eye[k] = atof(argv[++i]); }
+        else if (arg == "--look-at") { options.hasLookAt = true; for (int k = 0; k < 3; k++) options.lookAt[k] = atof(argv[++i]); }
+        else if (arg == "--look") { options.hasLook = true; for (int k = 0; k < 3; k++) options.look[k] = atof(argv[++i]); }
+        else if (arg == "--up") { options.hasUp = true; for (int k = 0; k < 3; k++) options.up[k] = atof(argv[++i]); }
+        else if (arg == "--fov") options.fov = atof(argv[++i]);
+        else if (arg == "--samples") options.samples = atoi(argv[++i]);
+        else if (arg == "--frame") options.frame = atoi(argv[++i]);
+        else if (arg == "--quality") options.quality = atoi(argv[++i]);
+        else if (arg == "--cost-view") options.costView = atoi(argv[++i]);
+        else if (arg == "--max-frames") options.maxFrames = atoi(argv[++i]);
+        else if (arg == "--path") options.path = argv[++i];
+        else if (arg == "--frames") { options.hasFrames = true; options.firstFrame = atoi(argv[++i]); options.lastFrame = atoi(argv[++i]); }
+        else if (arg == "--time-step") options.timeStep = atoi(argv[++i]);
+        else if (arg == "--help" || arg == "-h") { printUsage(argv[0]); return 0; }
+        else if (arg.compare(0, 2, "--") == 0 || !options.asset.empty()) {
+            std::cerr << "Unknown option " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        else options.asset = arg;
+    }
+    if (options.width < 1 || options.height < 1 || options.samples < 0 || options.frame < 0 || options.maxFrames < 1
+        || options.quality < 0 || options.quality > 2 || options.costView < 0 || options.costView > 4
+        || options.firstFrame < 0 || options.lastFrame < options.firstFrame || options.timeStep < 0) {
+        std::cerr << "Invalid parameters" << std::endl;
+        return 1;
+    }
+    if (!hasSuffix(options.out, ".png") && !hasSuffix(options.out, ".ppm") && !hasSuffix(options.out, ".exr")) {
+        std::cerr << "Output must be .png, .ppm or .exr" << std::endl;
+        return 1;
+    }
+    if (!validPattern(options.out)) {
+        std::cerr << "Frame numbers in the output name are written %d or %04d" << std::endl;
+        return 1;
+    }
+
+    EGLState egl;
+    if (!createContext(egl) || !loadGL()) {
+        destroyContext(egl);
+        return 1;
+    }
+    std::cerr << "OpenGL " << glGetString(GL_VERSION) << ", " << glGetString(GL_RENDERER) << std::endl;
+
+    // a canvas that is never shown: FLTK only keeps its size, the GL work happens in drawOffscreen.
+    // Frames at a fixed time and resolution, so nothing depends on the speed of the machine.
+    MyGLCanvas* canvas = new MyGLCanvas(0, 0, options.width, options.height);
+    canvas->animate = 0;
+    canvas->dynamicResolution = 0;
+    canvas->progressive = options.samples > 0;
+    canvas->progressiveSamples = options.samples;
+    canvas->setRenderQuality(options.quality);
+    canvas->costView = options.costView;
+    Target target = createTarget(options.width, options.height);
+    Readback readback;
+    createReadback(readback, options.width, options.height);
+
+    bool loaded = true;
+    if (hasSuffix(options.asset, ".ply")) {
+        canvas->loadPLY(options.asset);
+    }
+    else if (!options.asset.empty()) {
+        canvas->loadSceneFile(options.asset.c_str());
+        loaded = canvas->parser != NULL;
+    }
+    std::vector<Keyframe> keys;
+    if (!loaded) {
+        std::cerr << "Unable to load " << options.asset << std::endl;
+    }
+    else if (!options.path.empty()) {
+        // --fov is the view angle of keyframes without one
+        applyCamera(canvas->camera, options);
+        loaded = loadPath(options.path, canvas->camera->getViewAngle(), keys);
+        if (loaded && !options.hasFrames) {
+            options.firstFrame = keys.front().frame;
+            options.lastFrame = keys.back().frame;
+        }
+    }
+    if (loaded) {
+        applyCamera(canvas->camera, options);       // the path, if any, replaces it frame by frame
+        bool sequence = options.lastFrame > options.firstFrame;
+        FrameWriter writer(options.width, options.height);
+        std::string name;
+
+        auto start = std::chrono::steady_clock::now();
+        int draws = 0;
+        for (int n = options.firstFrame; n <= options.lastFrame; n++) {
+            if (!keys.empty()) {
+                applyPath(canvas->camera, keys, n);
+            }
+            canvas->setAnimationFrame(options.frame + n * options.timeStep);
+            auto frameStart = std::chrono::steady_clock::now();
+            int frames = 0;
+            do {
+                canvas->drawOffscreen(target.fbo);
+                canvas->finishCloudLight();
+                frames++;
+            } while (canvas->needsRedraw() && frames < options.maxFrames);
+            draws += frames;
+
+            // copy this frame, then hand over the one before, whose copy ran during this frame
+            startReadback(readback, target, options.width, options.height, frameName(options.out, n, sequence));
+            std::vector<float> pixels = finishReadback(readback, readback.next, options.width, options.height, name);
+            if (!name.empty()) {
+                writer.queue(name, std::move(pixels));
+            }
+            if (sequence) {
+                std::cerr << "frame " << n << ": " << frames << " draws (" << elapsedMs(frameStart) << " ms)" << std::endl;
+            }
+        }
+        std::vector<float> pixels = finishReadback(readback, 1 - readback.next, options.width, options.height, name);
+        writer.queue(name, std::move(pixels));
+        GLenum err = glGetError();
+        if (err != GL_NO_ERROR) {
+            std::cerr << "GL error 0x" << std::hex << err << std::dec << std::endl;
+        }
+
+        int failed = writer.finish();
+        int count = options.lastFrame - options.firstFrame + 1;
+        std::cerr << count << " x " << options.width << " x " << options.height << " from " << draws << " draws ("
+                  << elapsedMs(start) << " ms)" << std::endl;
+        if (failed == 0) {
+            std::cerr << "written to " << frameName(options.out, options.firstFrame, sequence) << (sequence ? " ..." : "") << std::endl;
+        }
+        loaded = failed == 0;
+    }
+
+    glDeleteBuffers(2, readback.buffers);
+    glDeleteFramebuffers(1, &target.fbo);
+    glDeleteTextures(1, &target.texture);
+    delete canvas;
+    destroyContext(egl);
+    return loaded ? 0 : 1;
+}
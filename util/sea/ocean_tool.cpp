@@ -0,0 +1,199 @@
+// Command line front end for the ocean spectrum in src/shaders/ocean.cpp.
+//
+// Replaces sea_phillips.py / sea_phillips_massive.py:
+//   ocean_tool --N 64 --L 128 --spectrum sea.glsl
+// and bakes height / normal map sequences:
+//   ocean_tool --height data/ppm/sea --normal data/ppm/sea_normal --size 256 --frames 60 --dt 0.05
+//
+// Build with `make ocean_tool`.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include "shaders/ocean.h"
+#include "shaders/ppm.h"
+
+namespace {
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --N <int>               grid resolution (default 32)\n"
+              << "  --L <float>             patch size (default 64)\n"
+              << "  --wind-speed <float>    wind speed (default 32)\n"
+              << "  --wind-dir <x> <z>      wind direction (default 1 0)\n"
+              << "  --damping <float>       small wave damping (default 0.001)\n"
+              << "  --amplitude <float>     energy scale A (default 0.0002)\n"
+              << "  --full                  use the full wave vector plane instead of half\n"
+              << "  --seed <int>            phase offset seed (default 42)\n"
+              << "  --spectrum <file|->     write the waves as GLSL arrays\n"
+              << "  --csv <file|->          write the waves as CSV (dirX,dirZ,omega,amplitude,phase)\n"
+              << "  --height <prefix>       bake height maps to <prefix>[_<frame>].ppm\n"
+              << "  --normal <prefix>       bake normal maps to <prefix>[_<frame>].ppm\n"
+              << "  --size <int>            baked map resolution (default 256)\n"
+              << "  --world <float>         world size covered by a baked map (default L)\n"
+              << "  --frames <int>          number of baked frames (default 1)\n"
+              << "  --dt <float>            time between baked frames (default 0.1)\n";
+}
+
+// Same layout as format_glsl_array in sea_phillips.py
+void writeGLSL(std::ostream& out, const std::vector<WaveData>& waves) {
+    const int perLine = 4;
+    size_t count = waves.size();
+    char buffer[64];
+
+    out << "const int WAVE_COUNT = " << count << ";\n";
+    out << "const vec2 freqDir[" << count << "] = vec2[](\n";
+    for (size_t i = 0; i < count; i++) {
+        snprintf(buffer, sizeof(buffer), "vec2(%.6f, %.6f)", waves[i].dirX, waves[i].dirZ);
+        out << (i % perLine == 0 ? "    " : " ") << buffer << (i + 1 < count ? "," : "") << ((i + 1) % perLine == 0 || i + 1 == count ? "\n" : "");
+    }
+    out << ");\n";
+
+    const char* names[] = { "freqOmega", "freqAmp", "freqPhaseOffset" };
+    for (int array = 0; array < 3; array++) {
+        out << "const float " << names[array] << "[" << count << "] = float[](\n";
+        for (size_t i = 0; i < count; i++) {
+            float value = array == 0 ? waves[i].omega : array == 1 ? waves[i].amplitude : waves[i].phaseOffset;
+            snprintf(buffer, sizeof(buffer), "%.6f", value);
+            out << (i % perLine == 0 ? "    " : " ") << buffer << (i + 1 < count ? "," : "") << ((i + 1) % perLine == 0 || i + 1 == count ? "\n" : "");
+        }
+        out << ");\n";
+    }
+}
+
+void writeCSV(std::ostream& out, const std::vector<WaveData>& waves) {
+    char buffer[128];
+    out << "dirX,dirZ,omega,amplitude,phaseOffset\n";
+    for (const WaveData& w : waves) {
+        snprintf(buffer, sizeof(buffer), "%.6f,%.6f,%.6f,%.6f,%.6f\n", w.dirX, w.dirZ, w.omega, w.amplitude, w.phaseOffset);
+        out << buffer;
+    }
+}
+
+bool writeOutput(const std::string& target, const std::vector<WaveData>& waves, bool csv) {
+    if (target == "-") {
+        csv ? writeCSV(std::cout, waves) : writeGLSL(std::cout, waves);
+        return true;
+    }
+    std::ofstream file(target);
+    if (!file) {
+        std::cerr << "Unable to write " << target << std::endl;
+        return false;
+    }
+    csv ? writeCSV(file, waves) : writeGLSL(file, waves);
+    return true;
+}
+
+std::string frameName(const std::string& prefix, int frame, int frames) {
+    if (frames == 1) {
+        return prefix + ".ppm";
+    }
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%04d.ppm", frame);
+    return prefix + suffix;
+}
+
+inline int toByte(float v) {
+    return std::min(255, std::max(0, (int)(v * 255.0f + 0.5f)));
+}
+
+}
+
+int main(int argc, char** argv) {
+    OceanParams params;
+    std::string spectrumFile, csvFile, heightPrefix, normalPrefix;
+    int size = 256;
+    int frames = 1;
+    float dt = 0.1f;
+    float world = -1.0f;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        // number of values that must follow the option
+        int needed = (arg == "--full" || arg == "--help" || arg == "-h") ? 0 : (arg == "--wind-dir" ? 2 : 1);
+        if (i + needed >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return 1;
+        }
+        if (arg == "--N") params.N = atoi(argv[++i]);
+        else if (arg == "--L") params.L = atof(argv[++i]);
+        else if (arg == "--wind-speed") params.windSpeed = atof(argv[++i]);
+        else if (arg == "--wind-dir") { params.windDirX = atof(argv[++i]); params.windDirZ = atof(argv[++i]); }
+        else if (arg == "--damping") params.damping = atof(argv[++i]);
+        else if (arg == "--amplitude") params.waveAmp = atof(argv[++i]);
+        else if (arg == "--full") params.halfPlane = false;
+        else if (arg == "--seed") params.seed = (unsigned int)atoi(argv[++i]);
+        else if (arg == "--spectrum") spectrumFile = argv[++i];
+        else if (arg == "--csv") csvFile = argv[++i];
+        else if (arg == "--height") heightPrefix = argv[++i];
+        else if (arg == "--normal") normalPrefix = argv[++i];
+        else if (arg == "--size") size = atoi(argv[++i]);
+        else if (arg == "--world") world = atof(argv[++i]);
+        else if (arg == "--frames") frames = atoi(argv[++i]);
+        else if (arg == "--dt") dt = atof(argv[++i]);
+        else if (arg == "--help" || arg == "-h") { printUsage(argv[0]); return 0; }
+        else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (params.N < 2 || params.L <= 0.0f || size < 1 || frames < 1) {
+        std::cerr << "Invalid parameters" << std::endl;
+        return 1;
+    }
+    if (world <= 0.0f) {
+        world = params.L;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<WaveData> waves = generatePhillipsSpectrum(params);
+    double spectrumMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << waves.size() << " waves (" << spectrumMs << " ms)" << std::endl;
+
+    if (spectrumFile.empty() && csvFile.empty() && heightPrefix.empty() && normalPrefix.empty()) {
+        spectrumFile = "-";
+    }
+    if (!spectrumFile.empty() && !writeOutput(spectrumFile, waves, false)) return 1;
+    if (!csvFile.empty() && !writeOutput(csvFile, waves, true)) return 1;
+
+    if (heightPrefix.empty() && normalPrefix.empty()) {
+        return 0;
+    }
+
+    // the height can never exceed the sum of the amplitudes, so every frame shares one scale
+    float maxHeight = 0.0f;
+    for (const WaveData& w : waves) {
+        maxHeight += w.amplitude;
+    }
+    maxHeight = std::max(maxHeight, 1e-6f);
+
+    std::vector<float> heights, normals;
+    ppm heightMap(size, size);
+    ppm normalMap(size, size);
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        bakeWaveMaps(waves, size, world, frame * dt, heights, normals);
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                size_t index = (size_t)y * size + x;
+                int h = toByte(heights[index] / maxHeight * 0.5f + 0.5f);
+                heightMap.setPixel(x, y, h, h, h);
+                normalMap.setPixel(x, y, toByte(normals[3 * index] * 0.5f + 0.5f),
+                                         toByte(normals[3 * index + 1] * 0.5f + 0.5f),
+                                         toByte(normals[3 * index + 2] * 0.5f + 0.5f));
+            }
+        }
+        if (!heightPrefix.empty() && !heightMap.save(frameName(heightPrefix, frame, frames))) return 1;
+        if (!normalPrefix.empty() && !normalMap.save(frameName(normalPrefix, frame, frames))) return 1;
+    }
+    double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << frames << " frame(s) of " << size << "x" << size << " baked (" << bakeMs << " ms)" << std::endl;
+    return 0;
+}